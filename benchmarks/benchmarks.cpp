@@ -0,0 +1,657 @@
+// Benchmarks of loading, saving, snapshotting, exporting and editing a synthetic project.
+//
+// The size of the project is set with environment variables (see ProjectSpec),
+// e.g. MQS_BENCH_PARTS=10000 ./mqsprite-benchmarks
+// QTest prints the results, and they're also written as JSON to
+// $MQS_BENCH_RESULTS (benchmark_results.json by default) so runs can be diffed.
+
+#include "projectmodel.h"
+#include "mainwindow.h"
+#include "assettreewidget.h"
+#include "assettreemodel.h"
+#include "partwidget.h"
+#include "thumbnails.h"
+#include "undobudget.h"
+#include "commands.h"
+#include "jsonreader.h"
+#include "zip.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <random>
+
+struct ProjectSpec {
+	int folders = 20;
+	int parts = 500;
+	int modesPerPart = 3;
+	int framesPerMode = 4;
+	int composites = 50;
+	int width = 32;
+	int height = 32;
+};
+
+static int EnvironmentValue(const char* name, int defaultValue) {
+	bool ok = false;
+	const int value = qEnvironmentVariableIntValue(name, &ok);
+	return ok ? qMax(0, value) : defaultValue;
+}
+
+static ProjectSpec SpecFromEnvironment() {
+	ProjectSpec spec;
+	spec.folders = EnvironmentValue("MQS_BENCH_FOLDERS", spec.folders);
+	spec.parts = EnvironmentValue("MQS_BENCH_PARTS", spec.parts);
+	spec.modesPerPart = EnvironmentValue("MQS_BENCH_MODES", spec.modesPerPart);
+	spec.framesPerMode = qMax(1, EnvironmentValue("MQS_BENCH_FRAMES", spec.framesPerMode));
+	spec.composites = EnvironmentValue("MQS_BENCH_COMPOSITES", spec.composites);
+	spec.width = qMax(1, EnvironmentValue("MQS_BENCH_WIDTH", spec.width));
+	spec.height = qMax(1, EnvironmentValue("MQS_BENCH_HEIGHT", spec.height));
+	return spec;
+}
+
+// A blob of colour and some noise, so frames differ like hand drawn ones do
+static QImage GenerateFrame(std::mt19937& random, int width, int height) {
+	QImage image(width, height, QImage::Format_ARGB32);
+	image.fill(0x00000000);
+
+	std::uniform_int_distribution<int> colour(0, 255);
+	QPainter painter(&image);
+	painter.setPen(Qt::NoPen);
+	painter.setBrush(QColor(colour(random), colour(random), colour(random)));
+	std::uniform_int_distribution<int> x(0, width / 2);
+	std::uniform_int_distribution<int> y(0, height / 2);
+	painter.drawEllipse(x(random), y(random), width / 2, height / 2);
+	painter.end();
+
+	std::uniform_int_distribution<int> px(0, width - 1);
+	std::uniform_int_distribution<int> py(0, height - 1);
+	for (int i = 0; i < (width * height) / 16; i++) {
+		image.setPixel(px(random), py(random), qRgba(colour(random), colour(random), colour(random), 255));
+	}
+	return image;
+}
+
+static void GenerateProject(ProjectModel* pm, const ProjectSpec& spec) {
+	pm->clear();
+	std::mt19937 random(1234);
+
+	QList<AssetRef> folderRefs;
+	for (int i = 0; i < spec.folders; i++) {
+		auto folder = QSharedPointer<Folder>::create();
+		folder->ref = pm->createAssetRef(AssetType::Folder);
+		folder->name = QString("folder_%1").arg(i);
+		if (i > 0) folder->parent = folderRefs.at((i - 1) / 4);
+		folderRefs.append(folder->ref);
+		pm->folders.insert(folder->ref, folder);
+	}
+
+	const QStringList modeNames { "icon", "side", "wrld", "idle", "walk", "jump", "hurt", "die_" };
+	QList<AssetRef> partRefs;
+	for (int i = 0; i < spec.parts; i++) {
+		auto part = QSharedPointer<Part>::create();
+		part->ref = pm->createAssetRef(AssetType::Part);
+		part->name = QString("part_%1").arg(i);
+		if (!folderRefs.isEmpty()) part->parent = folderRefs.at(i % folderRefs.size());
+
+		for (int m = 0; m < spec.modesPerPart; m++) {
+			Part::Mode mode;
+			mode.width = spec.width;
+			mode.height = spec.height;
+			mode.numFrames = spec.framesPerMode;
+			mode.numPivots = 1;
+			mode.framesPerSecond = 8;
+			for (int f = 0; f < spec.framesPerMode; f++) {
+				mode.frames.append(Frame(QSharedPointer<QImage>::create(GenerateFrame(random, spec.width, spec.height))));
+				mode.anchor.append(QPoint(spec.width / 2, spec.height - 1));
+				mode.pivots[0].append(QPoint(spec.width / 2, spec.height / 2));
+				for (int p = 1; p < Part::MaxPivots; p++) {
+					mode.pivots[p].append(QPoint(0, 0));
+				}
+			}
+			part->modes.insert(m < modeNames.size() ? modeNames.at(m) : QString("m%1").arg(m), mode);
+		}
+		partRefs.append(part->ref);
+		pm->parts.insert(part->ref, part);
+	}
+
+	std::uniform_int_distribution<int> partIndex(0, qMax(0, partRefs.size() - 1));
+	for (int i = 0; i < spec.composites && !partRefs.isEmpty(); i++) {
+		auto comp = QSharedPointer<Composite>::create();
+		comp->ref = pm->createAssetRef(AssetType::Composite);
+		comp->name = QString("composite_%1").arg(i);
+		if (!folderRefs.isEmpty()) comp->parent = folderRefs.at(i % folderRefs.size());
+
+		const QStringList names { "body", "arm", "head" };
+		for (int c = 0; c < names.size(); c++) {
+			Composite::Child child;
+			child.part = partRefs.at(partIndex(random));
+			child.index = c;
+			child.parent = (c == 0) ? -1 : 0;
+			child.parentPivot = (c == 0) ? -1 : 0;
+			child.z = c;
+			if (c == 0) child.children = { 1, 2 };
+			comp->children.append(names.at(c));
+			comp->childrenMap.insert(names.at(c), child);
+		}
+		comp->root = 0;
+		pm->composites.insert(comp->ref, comp);
+	}
+}
+
+class Benchmarks: public QObject {
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void load_data();
+	void load();
+	void parseProjectData_data();
+	void parseProjectData();
+	void save_data();
+	void save();
+	void exportSimple();
+	void snapshot();
+	void createIcon();
+	void floodFill();
+	void drawOnPart();
+	void refreshPartWidget();
+	void undoBudget();
+	void copyParts();
+	void copyMode();
+	void lookupAssets();
+	void updateList_data();
+	void updateList();
+
+	// Not a benchmark, it replaces the generated project, so it runs last
+	void copyDeleteSaveUndo();
+
+private:
+	// Stores the average time of an iteration of the current benchmark for the JSON results
+	void record(const QElapsedTimer& timer, int iterations);
+
+	ProjectSpec mSpec;
+	QTemporaryDir mDir;
+	QString mBinaryProject;
+	QString mJsonProject;
+	MainWindow* mWindow = nullptr;
+	QJsonObject mResults;
+};
+
+void Benchmarks::record(const QElapsedTimer& timer, int iterations) {
+	if (iterations <= 0) return;
+	QString name = QTest::currentTestFunction();
+	if (QTest::currentDataTag()) name += QString("/") + QTest::currentDataTag();
+
+	// QTest may run a benchmark several times until the timing is stable, the last run counts
+	QJsonObject result;
+	result.insert("iterations", iterations);
+	result.insert("msecsPerIteration", timer.nsecsElapsed() / 1e6 / iterations);
+	mResults.insert(name, result);
+}
+
+void Benchmarks::initTestCase() {
+	QCoreApplication::setOrganizationName("Wizard Mode");
+	QCoreApplication::setApplicationName("MQ Sprite Benchmarks"); // don't touch the editor's settings
+	QVERIFY(mDir.isValid());
+
+	// The commands notify the main window, which owns the global project
+	mWindow = new MainWindow();
+	mSpec = SpecFromEnvironment();
+
+	QElapsedTimer timer;
+	timer.start();
+	GenerateProject(PM(), mSpec);
+	qInfo() << "Generated" << PM()->parts.size() << "parts in" << timer.elapsed() << "ms";
+
+	mJsonProject = mDir.filePath("synthetic_json.mqs");
+	GlobalPreferences().binaryProjectData = false;
+	QVERIFY(PM()->save(mJsonProject));
+
+	mBinaryProject = mDir.filePath("synthetic.mqs");
+	GlobalPreferences().binaryProjectData = true;
+	QVERIFY(PM()->save(mBinaryProject));
+
+	mWindow->partListChanged();
+}
+
+void Benchmarks::cleanupTestCase() {
+	delete mWindow;
+	mWindow = nullptr;
+
+	QJsonObject project;
+	project.insert("folders", mSpec.folders);
+	project.insert("parts", mSpec.parts);
+	project.insert("modesPerPart", mSpec.modesPerPart);
+	project.insert("framesPerMode", mSpec.framesPerMode);
+	project.insert("composites", mSpec.composites);
+	project.insert("width", mSpec.width);
+	project.insert("height", mSpec.height);
+
+	QJsonObject root;
+	root.insert("date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+	root.insert("qtVersion", QString(qVersion()));
+	root.insert("project", project);
+	root.insert("results", mResults);
+
+	QString fileName = qEnvironmentVariable("MQS_BENCH_RESULTS", "benchmark_results.json");
+	QFile file(fileName);
+	QVERIFY2(file.open(QIODevice::WriteOnly), qPrintable("Couldn't write " + fileName));
+	file.write(QJsonDocument(root).toJson());
+	qInfo() << "Wrote results to" << fileName;
+}
+
+void Benchmarks::load_data() {
+	QTest::addColumn<bool>("binary");
+	QTest::addColumn<bool>("lazy");
+	QTest::newRow("binary lazy") << true << true;
+	QTest::newRow("binary eager") << true << false;
+	QTest::newRow("json lazy") << false << true;
+}
+
+void Benchmarks::load() {
+	QFETCH(bool, binary);
+	QFETCH(bool, lazy);
+	const bool wasLazy = GlobalPreferences().lazyLoadFrames;
+	GlobalPreferences().lazyLoadFrames = lazy;
+
+	ProjectModel pm;
+	QString reason;
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		pm.clear();
+		QVERIFY2(pm.load(binary ? mBinaryProject : mJsonProject, reason), qPrintable(reason));
+		iterations++;
+	}
+	record(timer, iterations);
+	QCOMPARE(pm.parts.size(), mSpec.parts);
+	GlobalPreferences().lazyLoadFrames = wasLazy;
+}
+
+// Only the parsing of data.json, with the streaming reader the loader uses and with
+// the QJsonDocument it used before
+void Benchmarks::parseProjectData_data() {
+	QTest::addColumn<bool>("streaming");
+	QTest::newRow("JsonReader") << true;
+	QTest::newRow("QJsonDocument") << false;
+}
+
+void Benchmarks::parseProjectData() {
+	QFETCH(bool, streaming);
+
+	ZipReader archive;
+	QVERIFY(archive.open(mJsonProject));
+	const QByteArray data = archive.read("data.json");
+	QVERIFY(!data.isEmpty());
+
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		if (streaming) {
+			JsonReader reader(data);
+			int strings = 0;
+			while (reader.readNext() != JsonReader::EndDocument) {
+				QVERIFY2(!reader.hasError(), qPrintable(reader.errorString()));
+				if (reader.token() == JsonReader::String) strings += reader.toString().isEmpty() ? 0 : 1;
+			}
+			QVERIFY(strings > 0);
+		}
+		else {
+			QJsonParseError error;
+			const QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+			QVERIFY2(error.error == QJsonParseError::NoError, qPrintable(error.errorString()));
+			QVERIFY(doc.object().contains("version"));
+		}
+		iterations++;
+	}
+	record(timer, iterations);
+}
+
+void Benchmarks::save_data() {
+	QTest::addColumn<bool>("modified");
+	QTest::newRow("unchanged") << false;
+	QTest::newRow("modified") << true;
+}
+
+void Benchmarks::save() {
+	QFETCH(bool, modified);
+
+	ProjectModel pm;
+	QString reason;
+	QVERIFY2(pm.load(mBinaryProject, reason), qPrintable(reason));
+	const QString fileName = mDir.filePath("saved.mqs");
+
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		if (modified) {
+			// As if every frame was drawn on, so they're all hashed and encoded again
+			for (const auto& part : pm.parts) {
+				for (const auto& mode : part->modes) {
+					for (const auto& frame : mode.frames) pm.resetImageCache(frame);
+				}
+			}
+		}
+		QVERIFY(pm.save(fileName));
+		iterations++;
+	}
+	record(timer, iterations);
+}
+
+void Benchmarks::exportSimple() {
+	ProjectModel pm;
+	QString reason;
+	QVERIFY2(pm.load(mBinaryProject, reason), qPrintable(reason));
+	const QString directory = mDir.filePath("export");
+	QVERIFY(QDir().mkpath(directory));
+
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		QVERIFY(pm.exportSimple(directory));
+		iterations++;
+	}
+	record(timer, iterations);
+}
+
+// The part of an autosave that blocks the UI
+void Benchmarks::snapshot() {
+	QSharedPointer<ProjectModel> copy;
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		copy = PM()->snapshot();
+		iterations++;
+	}
+	record(timer, iterations);
+	QCOMPARE(copy->parts.size(), PM()->parts.size());
+}
+
+void Benchmarks::createIcon() {
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		for (const auto& part : PM()->parts) {
+			Thumbnails::createImage(Thumbnails::sourceFrames(*part));
+		}
+		iterations++;
+	}
+	record(timer, iterations);
+}
+
+void Benchmarks::floodFill() {
+	// A large canvas with walls, so the fill has to wind around them
+	QImage image(512, 512, QImage::Format_ARGB32);
+	image.fill(0x00000000);
+	for (int x = 16; x < image.width(); x += 32) {
+		for (int y = (x / 32) % 2 ? 0 : 16; y < image.height() - 16; y++) {
+			image.setPixel(x, y, qRgba(0, 0, 0, 255));
+		}
+	}
+
+	QImage filled;
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		filled = FloodFill(image, QPoint(0, 0), qRgba(255, 0, 0, 255));
+		iterations++;
+	}
+	record(timer, iterations);
+	QCOMPARE(filled.pixel(image.width() - 1, image.height() - 1), qRgba(255, 0, 0, 255));
+}
+
+void Benchmarks::drawOnPart() {
+	QVERIFY(!PM()->parts.isEmpty());
+	Part* part = PM()->parts.first().data();
+	const QString mode = part->modes.firstKey();
+
+	// A dab of a brush on the frame-sized overlay PartWidget hands over
+	const QImage& frame = *part->modes.first().frames.first();
+	QImage stamp(frame.size(), QImage::Format_ARGB32);
+	stamp.fill(0x00000000);
+	QPainter(&stamp).fillRect(4, 4, 8, 8, QColor(0, 255, 0));
+
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		CDrawOnPart command(part->ref, mode, 0, stamp, QPoint(0, 0));
+		QVERIFY(command.ok);
+		command.redo();
+		command.undo();
+		iterations++;
+	}
+	record(timer, iterations);
+}
+
+// A part widget catching up with a small stroke on one frame of its mode, which
+// repaints that part of the frame's pixmap only
+void Benchmarks::refreshPartWidget() {
+	QVERIFY(!PM()->parts.isEmpty());
+	Part* part = PM()->parts.first().data();
+	const QString mode = part->modes.firstKey();
+	PartWidget widget(part->ref);
+	widget.setMode(mode);
+	QCOMPARE(widget.numFrames(), part->modes.first().numFrames);
+
+	const QRect dab(4, 4, 8, 8);
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		widget.partFrameUpdated(part->ref, mode, 0, dab);
+		iterations++;
+	}
+	record(timer, iterations);
+}
+
+// Keeping the frames held for undo within a budget after a run of strokes, which
+// compresses and spills the older ones
+void Benchmarks::undoBudget() {
+	QVERIFY(!PM()->parts.isEmpty());
+	Part* part = PM()->parts.first().data();
+	const QString mode = part->modes.firstKey();
+	const QImage& frame = *part->modes.first().frames.first();
+	QUndoStack* stack = mWindow->undoStack();
+	UndoBudget* budget = mWindow->undoBudget();
+	const qint64 oldBudget = budget->budget();
+	budget->setBudget(frame.sizeInBytes() * 8);
+
+	// Strokes over the whole frame, so each one holds two frames of pixels
+	QImage stroke(frame.size(), QImage::Format_ARGB32);
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		for (int i = 0; i < 50; i++) {
+			stroke.fill(qRgba(i * 5, 255 - i * 5, 0, 255));
+			QVERIFY(TryCommand(new CDrawOnPart(part->ref, mode, 0, stroke, QPoint(0, 0))));
+		}
+		budget->update();
+		iterations++;
+	}
+	record(timer, iterations);
+	QVERIFY(budget->usage() <= budget->budget());
+
+	// Undoing the oldest strokes reads their pixels back from the scratch file
+	while (stack->canUndo()) stack->undo();
+	stack->clear();
+	budget->setBudget(oldBudget);
+}
+
+// What duplicating a part does to the project, without the windows the commands open.
+// Each copy looks for a free name, which used to scan every part for every candidate.
+void Benchmarks::copyParts() {
+	QVERIFY(!PM()->parts.isEmpty());
+	const auto original = PM()->parts.first();
+	const int copies = 100;
+
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		QList<AssetRef> refs;
+		for (int i = 0; i < copies; i++) {
+			auto copy = QSharedPointer<Part>::create(*original);
+			copy->ref = PM()->createAssetRef(AssetType::Part);
+			copy->name = PM()->uniqueName(AssetType::Part, original->name, 1);
+			PM()->insertPart(copy);
+			refs.append(copy->ref);
+		}
+		for (const auto& ref : refs) {
+			PM()->takePart(ref);
+		}
+		iterations++;
+	}
+	record(timer, iterations);
+	QVERIFY(PM()->findPartByName(original->name) == original.data());
+}
+
+// Duplicating a mode, whose frames share their pixels with the original until drawn on
+void Benchmarks::copyMode() {
+	QVERIFY(!PM()->parts.isEmpty());
+	Part* part = PM()->parts.first().data();
+	const QString mode = part->modes.firstKey();
+	const int modes = part->modes.size();
+
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		CCopyMode command(part->ref, mode);
+		QVERIFY(command.ok);
+		command.redo();
+		QCOMPARE(part->modes.size(), modes + 1);
+		command.undo();
+		iterations++;
+	}
+	record(timer, iterations);
+
+	// A decoded frame's copy shares its buffer, one that isn't decodes on its own
+	const QStringList before = part->modes.keys();
+	CCopyMode command(part->ref, mode);
+	command.redo();
+	const Frame original = part->modes.value(mode).frames.first();
+	for (const auto& name : part->modes.keys()) {
+		if (before.contains(name) || !original.isLoaded()) continue;
+		QVERIFY(part->modes.value(name).frames.first()->constBits() == original->constBits());
+	}
+	command.undo();
+}
+
+// Drawing composites, the tree and the commands look up assets by ref all the time
+void Benchmarks::lookupAssets() {
+	QList<AssetRef> refs = PM()->folders.keys() + PM()->parts.keys() + PM()->composites.keys();
+	for (const auto& comp : PM()->composites) {
+		for (const auto& child : comp->childrenMap) refs.append(child.part);
+	}
+	QVERIFY(!refs.isEmpty());
+
+	int found = 0;
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		found = 0;
+		for (int i = 0; i < 100; i++) {
+			for (const auto& ref : refs) {
+				if (PM()->getAsset(ref)) found++;
+			}
+		}
+		iterations++;
+	}
+	record(timer, iterations);
+	QCOMPARE(found, refs.size() * 100);
+}
+
+void Benchmarks::updateList_data() {
+	QTest::addColumn<bool>("reset");
+	QTest::newRow("rename") << false;
+	QTest::newRow("reset") << true;
+}
+
+// Updating the asset tree after an edit, or after opening a project, and asking for
+// the icons of the rows a view would draw first (they're made in the background)
+void Benchmarks::updateList() {
+	QFETCH(bool, reset);
+	QVERIFY(!PM()->parts.isEmpty());
+	AssetTreeWidget tree;
+	AssetTreeModel* model = tree.assetModel();
+	const AssetRef ref = PM()->parts.first()->ref;
+	const QString name = PM()->getPart(ref)->name;
+
+	QElapsedTimer timer;
+	int iterations = 0;
+	timer.start();
+	QBENCHMARK {
+		if (reset) {
+			tree.resetIcons();
+		}
+		else {
+			PM()->renameAsset(ref, iterations % 2 ? name : name + "_renamed");
+			tree.updateList();
+		}
+		for (int row = 0; row < qMin(model->rowCount(), 50); row++) {
+			model->index(row, 0).data(Qt::DecorationRole);
+		}
+		iterations++;
+	}
+	record(timer, iterations);
+	PM()->renameAsset(ref, name);
+	QVERIFY(tree.selectAsset(ref));
+}
+
+// A copy of a part whose frames aren't decoded yet refers to the project's archive. It
+// has to keep its pixels when it's only held by the undo stack while the archive is replaced.
+void Benchmarks::copyDeleteSaveUndo() {
+	const bool wasLazy = GlobalPreferences().lazyLoadFrames;
+	GlobalPreferences().lazyLoadFrames = true;
+	const QString fileName = mDir.filePath("copy_delete.mqs");
+	QFile::remove(fileName);
+	QVERIFY(QFile::copy(mBinaryProject, fileName));
+
+	QString reason;
+	ProjectModel reference;
+	QVERIFY2(reference.load(fileName, reason), qPrintable(reason));
+	QVERIFY2(PM()->load(fileName, reason), qPrintable(reason));
+	GlobalPreferences().lazyLoadFrames = wasLazy;
+
+	const AssetRef original = PM()->parts.keys().first();
+	const QString mode = PM()->getPart(original)->modes.firstKey();
+	QVERIFY(!PM()->getPart(original)->modes.first().frames.first().isLoaded());
+	const QList<AssetRef> before = PM()->parts.keys();
+
+	QUndoStack stack;
+	stack.push(new CCopyPart(original));
+	AssetRef copy;
+	for (const auto& ref : PM()->parts.keys()) {
+		if (!before.contains(ref)) copy = ref;
+	}
+	QVERIFY(!copy.isNull());
+	stack.push(new CDeletePart(copy));
+	QVERIFY(!PM()->hasPart(copy));
+
+	QVERIFY(PM()->save(fileName));
+	stack.undo();
+	QVERIFY(PM()->hasPart(copy));
+	const Frame frame = PM()->getPart(copy)->modes.value(mode).frames.first();
+	QVERIFY(!frame->isNull());
+	QVERIFY(*frame == *reference.getPart(original)->modes.value(mode).frames.first());
+}
+
+QTEST_MAIN(Benchmarks)
+#include "benchmarks.moc"
@@ -0,0 +1,11 @@
+# Benchmarks of the editor on a synthetic project, see benchmarks.cpp
+TEMPLATE = app
+TARGET = mqsprite-benchmarks
+QT += core gui widgets testlib
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(../mmpixel.pri)
+
+SOURCES += \
+    benchmarks.cpp
@@ -0,0 +1,73 @@
+# The editor sources, shared by mmpixel.pro and benchmarks/benchmarks.pro
+INCLUDEPATH += $$PWD $$PWD/src
+
+HEADERS += \
+    $$PWD/src/commands.h \
+    $$PWD/src/compositetoolswidget.h \
+    $$PWD/src/compositewidget.h \
+    $$PWD/src/mainwindow.h \
+    $$PWD/src/paletteview.h \
+    $$PWD/src/partlist.h \
+    $$PWD/src/partwidget.h \
+    $$PWD/src/projectmodel.h \
+    $$PWD/src/slotmap.h \
+    $$PWD/src/resizemodedialog.h \
+    $$PWD/src/assettreewidget.h \
+    $$PWD/src/assettreemodel.h \
+    $$PWD/src/thumbnails.h \
+    $$PWD/src/modelistwidget.h \
+    $$PWD/src/drawingtools.h \
+    $$PWD/src/propertieswidget.h \
+    $$PWD/src/animationwidget.h \
+    $$PWD/src/spritezoomwidget.h \
+    $$PWD/src/optionswidget.h \
+    $$PWD/src/parallel.h \
+    $$PWD/src/atlaspacker.h \
+    $$PWD/src/xxhash.h \
+    $$PWD/src/zip.h \
+    $$PWD/src/autosave.h \
+    $$PWD/src/journal.h \
+    $$PWD/src/undobudget.h \
+    $$PWD/src/changebus.h \
+    $$PWD/src/jsonreader.h
+
+FORMS += \
+    $$PWD/src/compositetoolswidget.ui \
+    $$PWD/src/mainwindow.ui \
+    $$PWD/src/partlist.ui \
+    $$PWD/src/resizemodedialog.ui \
+    $$PWD/src/drawingtools.ui \
+    $$PWD/src/propertieswidget.ui \
+    $$PWD/src/animationwidget.ui \
+    $$PWD/src/spritezoomwidget.ui \
+    $$PWD/src/optionswidget.ui
+
+SOURCES += \
+    $$PWD/src/commands.cpp \
+    $$PWD/src/compositetoolswidget.cpp \
+    $$PWD/src/compositewidget.cpp \
+    $$PWD/src/mainwindow.cpp \
+    $$PWD/src/paletteview.cpp \
+    $$PWD/src/partlist.cpp \
+    $$PWD/src/partwidget.cpp \
+    $$PWD/src/projectmodel.cpp \
+    $$PWD/src/resizemodedialog.cpp \
+    $$PWD/src/assettreewidget.cpp \
+    $$PWD/src/assettreemodel.cpp \
+    $$PWD/src/thumbnails.cpp \
+    $$PWD/src/modelistwidget.cpp \
+    $$PWD/src/drawingtools.cpp \
+    $$PWD/src/propertieswidget.cpp \
+    $$PWD/src/animationwidget.cpp \
+    $$PWD/src/spritezoomwidget.cpp \
+    $$PWD/src/optionswidget.cpp \
+    $$PWD/src/atlaspacker.cpp \
+    $$PWD/src/zip.cpp \
+    $$PWD/src/autosave.cpp \
+    $$PWD/src/journal.cpp \
+    $$PWD/src/undobudget.cpp \
+    $$PWD/src/changebus.cpp \
+    $$PWD/src/jsonreader.cpp
+
+RESOURCES += \
+    $$PWD/icons.qrc
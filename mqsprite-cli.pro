@@ -0,0 +1,26 @@
+# Headless command line tool, see src/cli.cpp
+TEMPLATE = app
+TARGET = mqsprite-cli
+INCLUDEPATH += . src
+QT += core gui
+QT -= widgets
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+HEADERS += \
+    src/projectmodel.h \
+    src/slotmap.h \
+    src/parallel.h \
+    src/atlaspacker.h \
+    src/xxhash.h \
+    src/zip.h \
+    src/journal.h \
+    src/jsonreader.h
+
+SOURCES += \
+    src/cli.cpp \
+    src/projectmodel.cpp \
+    src/atlaspacker.cpp \
+    src/zip.cpp \
+    src/journal.cpp \
+    src/jsonreader.cpp
@@ -0,0 +1,355 @@
+#include "assettreemodel.h"
+#include "commands.h"
+#include "mainwindow.h"
+#include "thumbnails.h"
+
+#include <algorithm>
+
+static int TypeOrder(AssetType type) {
+    switch (type) {
+    case AssetType::Folder: return 0;
+    case AssetType::Composite: return 1;
+    default: return 2;
+    }
+}
+
+AssetTreeModel::AssetTreeModel(QObject *parent)
+    :QAbstractItemModel(parent),
+      mFolderIcon(":/icon/icons/gentleface/folder_icon&16.png"),
+      mPartIcon(":/icon/icons/gentleface/picture_icon&16.png")
+{
+    mThumbnails = new Thumbnails(this);
+    connect(mThumbnails, &Thumbnails::iconReady, this, [this](AssetRef ref){
+        const Node* n = mNodes.value(ref);
+        if (n){
+            const QModelIndex index = nodeIndex(n);
+            emit dataChanged(index, index, { Qt::DecorationRole });
+        }
+    });
+    reset();
+}
+
+AssetTreeModel::~AssetTreeModel(){
+    for (Node* child: mRoot.children){
+        deleteNode(child);
+    }
+}
+
+AssetRef AssetTreeModel::assetRef(const QModelIndex& index) const {
+    return index.isValid() ? node(index)->ref : AssetRef();
+}
+
+QModelIndex AssetTreeModel::assetIndex(AssetRef ref){
+    const Asset* asset = PM()->getAsset(ref);
+    if (!asset) return QModelIndex();
+
+    // The folders it's in, innermost first
+    QVector<AssetRef> folders;
+    for (AssetRef parent = asset->parent; !parent.isNull(); ){
+        const Folder* folder = PM()->getFolder(parent);
+        if (!folder || folders.size() > PM()->folders.size()) return QModelIndex();
+        folders.append(parent);
+        parent = folder->parent;
+    }
+
+    for (int i = folders.size() - 1; i >= 0; i--){
+        Node* folder = mNodes.value(folders.at(i));
+        if (!folder) return QModelIndex();
+        if (!folder->populated) populate(folder);
+    }
+
+    const Node* n = mNodes.value(ref);
+    return n ? nodeIndex(n) : QModelIndex();
+}
+
+void AssetTreeModel::sync(){
+    // Move or remove the rows that don't match their asset anymore
+    const QList<AssetRef> refs = mNodes.keys();
+    for (const AssetRef& ref: refs){
+        Node* n = mNodes.value(ref);
+        if (!n) continue; // removed with its folder
+
+        const Asset* asset = PM()->getAsset(ref);
+        if (!asset){
+            removeNode(n);
+            continue;
+        }
+
+        Node* newParent = asset->parent.isNull() ? &mRoot : mNodes.value(asset->parent);
+        if (newParent == n->parent && asset->name == n->name) continue;
+
+        bool intoItself = false;
+        for (const Node* p = newParent; p && !intoItself; p = p->parent){
+            intoItself = (p == n);
+        }
+        if (!newParent || !newParent->populated || intoItself){
+            removeNode(n);
+        }
+        else {
+            moveNode(n, newParent, asset->name);
+        }
+    }
+
+    // Add the assets that don't have rows yet to the folders that do
+    QVector<Node*> folders { &mRoot };
+    for (int i = 0; i < folders.size(); i++){
+        Node* folder = folders.at(i);
+        const auto children = PM()->children(folder->ref);
+        if (children.size() != folder->children.size()){
+            for (const AssetRef& ref: children){
+                if (!mNodes.contains(ref)) insertNode(folder, ref);
+            }
+        }
+        for (Node* child: folder->children){
+            if (child->populated) folders.append(child);
+        }
+    }
+}
+
+void AssetTreeModel::reset(){
+    beginResetModel();
+    for (Node* child: mRoot.children){
+        deleteNode(child);
+    }
+    mNodes.clear();
+    mThumbnails->clear();
+    mRoot.children = createChildren(&mRoot);
+    mRoot.populated = true;
+    endResetModel();
+}
+
+void AssetTreeModel::updateIcon(AssetRef ref){
+    mThumbnails->invalidate(ref);
+
+    // The view asks for the icon again if the row is visible, the old one is shown until it's made
+    const Node* n = mNodes.value(ref);
+    if (n){
+        const QModelIndex index = nodeIndex(n);
+        emit dataChanged(index, index, { Qt::DecorationRole });
+    }
+}
+
+void AssetTreeModel::fetchAll(){
+    QVector<Node*> folders { &mRoot };
+    for (int i = 0; i < folders.size(); i++){
+        if (!folders.at(i)->populated) populate(folders.at(i));
+        for (Node* child: folders.at(i)->children){
+            if (child->ref.type == AssetType::Folder) folders.append(child);
+        }
+    }
+}
+
+QModelIndex AssetTreeModel::index(int row, int column, const QModelIndex& parent) const {
+    const Node* n = node(parent);
+    if (row < 0 || row >= n->children.size() || column != 0) return QModelIndex();
+    return createIndex(row, 0, n->children.at(row));
+}
+
+QModelIndex AssetTreeModel::parent(const QModelIndex& index) const {
+    if (!index.isValid()) return QModelIndex();
+    return nodeIndex(node(index)->parent);
+}
+
+int AssetTreeModel::rowCount(const QModelIndex& parent) const {
+    if (parent.column() > 0) return 0;
+    return node(parent)->children.size();
+}
+
+int AssetTreeModel::columnCount(const QModelIndex&) const {
+    return 1;
+}
+
+bool AssetTreeModel::hasChildren(const QModelIndex& parent) const {
+    const Node* n = node(parent);
+    if (n == &mRoot) return !n->children.isEmpty();
+    if (n->ref.type != AssetType::Folder) return false;
+    // A folder shows its indicator until it's expanded, like it always did
+    return !n->populated || !n->children.isEmpty();
+}
+
+bool AssetTreeModel::canFetchMore(const QModelIndex& parent) const {
+    const Node* n = node(parent);
+    return n != &mRoot && n->ref.type == AssetType::Folder && !n->populated;
+}
+
+void AssetTreeModel::fetchMore(const QModelIndex& parent){
+    if (canFetchMore(parent)) populate(node(parent));
+}
+
+QVariant AssetTreeModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid()) return QVariant();
+    const Node* n = node(index);
+    switch (role){
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+        return n->name;
+    case Qt::DecorationRole:
+        if (n->ref.type == AssetType::Folder){
+            return mFolderIcon;
+        }
+        else if (n->ref.type == AssetType::Part){
+            const Part* part = PM()->getPart(n->ref);
+            const QIcon icon = part ? mThumbnails->icon(*part) : QIcon();
+            return icon.isNull() ? mPartIcon : icon;
+        }
+        break;
+    }
+    return QVariant();
+}
+
+bool AssetTreeModel::setData(const QModelIndex& index, const QVariant& value, int role){
+    if (!index.isValid() || role != Qt::EditRole) return false;
+
+    const AssetRef ref = node(index)->ref;
+    const QString newName = value.toString();
+    if (newName.isEmpty() || newName == node(index)->name) return false;
+
+    switch (ref.type){
+    case AssetType::Folder: TryCommand(new CRenameFolder(ref, newName)); break;
+    case AssetType::Part: TryCommand(new CRenamePart(ref, newName)); break;
+    case AssetType::Composite: TryCommand(new CRenameComposite(ref, newName)); break;
+    }
+    MainWindow::Instance()->partListChanged();
+    return true;
+}
+
+Qt::ItemFlags AssetTreeModel::flags(const QModelIndex& index) const {
+    if (!index.isValid()) return Qt::ItemIsDropEnabled; // onto the top level
+    Qt::ItemFlags flags = Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsEditable | Qt::ItemIsDragEnabled;
+    if (node(index)->ref.type == AssetType::Folder){
+        flags |= Qt::ItemIsDropEnabled;
+    }
+    return flags;
+}
+
+Qt::DropActions AssetTreeModel::supportedDropActions() const {
+    return Qt::MoveAction;
+}
+
+bool AssetTreeModel::lessThan(const Node* a, const Node* b){
+    const int typeA = TypeOrder(a->ref.type);
+    const int typeB = TypeOrder(b->ref.type);
+    if (typeA != typeB) return typeA < typeB;
+    if (a->name != b->name) return a->name < b->name;
+    return a->ref.id < b->ref.id;
+}
+
+// Where node belongs among children, which are sorted apart from the child at skip (or -1)
+// that isn't counted
+int AssetTreeModel::insertionRow(const QVector<Node*>& children, const Node* node, int skip){
+    if (skip < 0){
+        return std::lower_bound(children.begin(), children.end(), node, lessThan) - children.begin();
+    }
+    const auto skipped = children.begin() + skip;
+    const auto it = std::lower_bound(children.begin(), skipped, node, lessThan);
+    if (it != skipped) return it - children.begin();
+    return std::lower_bound(skipped + 1, children.end(), node, lessThan) - children.begin() - 1;
+}
+
+AssetTreeModel::Node* AssetTreeModel::node(const QModelIndex& index) const {
+    if (!index.isValid()) return const_cast<Node*>(&mRoot);
+    return static_cast<Node*>(index.internalPointer());
+}
+
+QModelIndex AssetTreeModel::nodeIndex(const Node* n) const {
+    if (n == &mRoot) return QModelIndex();
+    return createIndex(row(n), 0, const_cast<Node*>(n));
+}
+
+int AssetTreeModel::row(const Node* n) const {
+    const auto& siblings = n->parent->children;
+    const int r = std::lower_bound(siblings.begin(), siblings.end(), n, lessThan) - siblings.begin();
+    Q_ASSERT(r < siblings.size() && siblings.at(r) == n);
+    return r;
+}
+
+AssetTreeModel::Node* AssetTreeModel::createNode(Node* parent, AssetRef ref){
+    Node* n = new Node;
+    n->ref = ref;
+    n->name = PM()->getAsset(ref)->name;
+    n->parent = parent;
+    mNodes.insert(ref, n);
+    return n;
+}
+
+QVector<AssetTreeModel::Node*> AssetTreeModel::createChildren(Node* parent){
+    QVector<Node*> children;
+    for (const AssetRef& ref: PM()->children(parent->ref)){
+        children.append(createNode(parent, ref));
+    }
+    std::sort(children.begin(), children.end(), lessThan);
+    return children;
+}
+
+void AssetTreeModel::deleteNode(Node* n){
+    for (Node* child: n->children){
+        deleteNode(child);
+    }
+    mNodes.remove(n->ref);
+    delete n;
+}
+
+void AssetTreeModel::populate(Node* n){
+    const QVector<Node*> children = createChildren(n);
+    if (children.isEmpty()){
+        n->populated = true;
+        return;
+    }
+    beginInsertRows(nodeIndex(n), 0, children.size() - 1);
+    n->children = children;
+    n->populated = true;
+    endInsertRows();
+}
+
+void AssetTreeModel::insertNode(Node* parent, AssetRef ref){
+    Node key;
+    key.ref = ref;
+    key.name = PM()->getAsset(ref)->name;
+    const int r = insertionRow(parent->children, &key, -1);
+    beginInsertRows(nodeIndex(parent), r, r);
+    parent->children.insert(r, createNode(parent, ref));
+    endInsertRows();
+}
+
+void AssetTreeModel::removeNode(Node* n){
+    const int r = row(n);
+    beginRemoveRows(nodeIndex(n->parent), r, r);
+    n->parent->children.remove(r);
+    deleteNode(n);
+    endRemoveRows();
+}
+
+void AssetTreeModel::moveNode(Node* n, Node* newParent, const QString& newName){
+    const int from = row(n);
+    Node key;
+    key.ref = n->ref;
+    key.name = newName;
+    const bool sameParent = (newParent == n->parent);
+    const int to = insertionRow(newParent->children, &key, sameParent ? from : -1);
+
+    if (sameParent && to == from){
+        // Renamed without changing places
+        n->name = newName;
+        const QModelIndex index = createIndex(from, 0, n);
+        emit dataChanged(index, index, { Qt::DisplayRole, Qt::EditRole });
+        return;
+    }
+
+    // The destination is a row before the move, so moving down within a folder is one further
+    const int destination = (sameParent && to > from) ? to + 1 : to;
+    if (!beginMoveRows(nodeIndex(n->parent), from, from, nodeIndex(newParent), destination)){
+        removeNode(n);
+        return;
+    }
+    const bool renamed = (n->name != newName);
+    n->parent->children.remove(from);
+    n->name = newName;
+    n->parent = newParent;
+    newParent->children.insert(to, n);
+    endMoveRows();
+
+    if (renamed){
+        const QModelIndex index = createIndex(to, 0, n);
+        emit dataChanged(index, index, { Qt::DisplayRole, Qt::EditRole });
+    }
+}
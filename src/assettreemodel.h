@@ -0,0 +1,76 @@
+#ifndef ASSETTREEMODEL_H
+#define ASSETTREEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QIcon>
+#include <QVector>
+#include "projectmodel.h"
+
+class Thumbnails;
+
+// The assets of the project as a tree of folders, each sorted by type then name.
+// The rows of a folder are only created when it's first expanded, and the icons of
+// parts are made in the background when they're first drawn. sync() brings the rows that exist up to date with
+// the project using row insertions, removals and moves, so the view keeps its
+// expanded folders and selection and only repaints what changed.
+class AssetTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    explicit AssetTreeModel(QObject *parent = nullptr);
+    ~AssetTreeModel();
+
+    AssetRef assetRef(const QModelIndex& index) const;
+
+    // Creates the rows of the folders the asset is in. Invalid if it's not in the tree.
+    QModelIndex assetIndex(AssetRef ref);
+
+    void sync(); // after assets were added, removed, renamed or moved
+    void reset(); // after the project was replaced
+    void updateIcon(AssetRef ref);
+    void fetchAll(); // creates the rows of every folder
+
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& index) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex& index, const QVariant& value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
+    Qt::DropActions supportedDropActions() const override;
+
+private:
+    struct Node {
+        AssetRef ref;
+        QString name; // the rows are sorted by the name at the last sync()
+        Node* parent = nullptr;
+        QVector<Node*> children;
+        bool populated = false; // the rows of a folder have been created
+    };
+
+    static bool lessThan(const Node* a, const Node* b);
+    static int insertionRow(const QVector<Node*>& children, const Node* node, int skip);
+
+    Node* node(const QModelIndex& index) const;
+    QModelIndex nodeIndex(const Node* node) const;
+    int row(const Node* node) const;
+    Node* createNode(Node* parent, AssetRef ref);
+    QVector<Node*> createChildren(Node* node); // sorted
+    void deleteNode(Node* node);
+    void populate(Node* node);
+    void insertNode(Node* parent, AssetRef ref);
+    void removeNode(Node* node);
+    void moveNode(Node* node, Node* newParent, const QString& newName);
+
+    Node mRoot;
+    QHash<AssetRef, Node*> mNodes;
+    Thumbnails* mThumbnails = nullptr;
+    QIcon mFolderIcon;
+    QIcon mPartIcon;
+};
+
+#endif // ASSETTREEMODEL_H
@@ -1,33 +1,28 @@
 #ifndef ASSETTREEWIDGET_H
 #define ASSETTREEWIDGET_H
 
-#include <QTreeWidget>
-#include <QVector>
-#include <QSet>
+#include <QTreeView>
 #include <QString>
 #include "projectmodel.h"
 
-class AssetTreeWidget : public QTreeWidget
+class AssetTreeModel;
+
+// Shows the assets of the project in an AssetTreeModel
+class AssetTreeWidget : public QTreeView
 {
     Q_OBJECT
 public:
     explicit AssetTreeWidget(QWidget *parent = nullptr);
 
-    AssetRef assetRef(int id) const;
-    const QString& assetName(int id) const;
-	bool selectAsset(AssetRef, QTreeWidgetItem* fromNode = nullptr);
+    AssetTreeModel* assetModel() const { return mModel; }
+	bool selectAsset(AssetRef ref);
 
 public slots:
-	void resetIcons();
+	void resetIcons(); // and everything else, after the project was replaced
     void updateList();
 	void updateIcon(AssetRef ref);
-    // void addAsset(AssetRef ref);
-    // void removeAsset(AssetRef ref);
 
-    void activateItem(QTreeWidgetItem* item, int col);
-    void expandItem(QTreeWidgetItem* item);
-    void collapseItem(QTreeWidgetItem* item);
-	void changeItem(QTreeWidgetItem* item, int col);
+    void activateItem(const QModelIndex& index);
 
 	void setFilter(const QString& filter);
 
@@ -38,22 +33,14 @@ signals:
 	void assetSelected(AssetRef ref);
 
 protected:
-    Qt::DropActions supportedDropActions() const;
     void dropEvent(QDropEvent *event);
-    void addAssetsWithParent(const QList<AssetRef>& assets, AssetRef parentRef, QTreeWidgetItem* parentItem, int& index);
     void keyPressEvent(QKeyEvent* event);
-	bool filterItem(const QString& text, QTreeWidgetItem* item);
-	
-	QTreeWidgetItem* findItem(std::function<bool(QTreeWidgetItem*)> searchQuery, QTreeWidgetItem* root = nullptr);
-	void applyToAllItems(std::function<void(QTreeWidgetItem*)> function, QTreeWidgetItem* root = nullptr);
+	bool filterRows(const QModelIndex& parent);
+	bool hasExpandedFolder(const QModelIndex& parent) const;
 
 protected:
-    QVector<AssetRef> mAssetRefs;
-    // QVector<QTreeWidgetItem*> mItems;
-    QVector<QString> mAssetNames;
-    QSet<AssetRef> mOpenFolders;
-    QPointF mStartPos;
-	QMap<AssetRef, QIcon> mAssetIcons;
+	AssetTreeModel* mModel = nullptr;
+	QString mFilter;
 };
 
 #endif // ASSETTREEWIDGET_H
@@ -0,0 +1,79 @@
+#include "atlaspacker.h"
+
+#include <algorithm>
+#include <limits>
+
+SkylinePacker::SkylinePacker(int width, int height):mWidth(width), mHeight(height) {
+	mSkyline.append({ 0, 0, width });
+}
+
+int SkylinePacker::fit(int index, const QSize& size) const {
+	const int x = mSkyline.at(index).x;
+	if (x + size.width() > mWidth) return -1;
+
+	// The rect rests on the highest node it spans
+	int y = 0;
+	int widthLeft = size.width();
+	for (int i = index; widthLeft > 0; i++) {
+		if (i == mSkyline.size()) return -1;
+		y = std::max(y, mSkyline.at(i).y);
+		if (y + size.height() > mHeight) return -1;
+		widthLeft -= mSkyline.at(i).width;
+	}
+	return y;
+}
+
+bool SkylinePacker::insert(const QSize& size, QPoint* position) {
+	if (size.width() <= 0 || size.height() <= 0) return false;
+
+	int bestIndex = -1;
+	int bestBottom = std::numeric_limits<int>::max();
+	int bestWidth = std::numeric_limits<int>::max();
+	int bestY = 0;
+	for (int i = 0; i < mSkyline.size(); i++) {
+		int y = fit(i, size);
+		if (y < 0) continue;
+		const int bottom = y + size.height();
+		if (bottom < bestBottom || (bottom == bestBottom && mSkyline.at(i).width < bestWidth)) {
+			bestIndex = i;
+			bestBottom = bottom;
+			bestWidth = mSkyline.at(i).width;
+			bestY = y;
+		}
+	}
+	if (bestIndex < 0) return false;
+
+	const Node node { mSkyline.at(bestIndex).x, bestY + size.height(), size.width() };
+	mSkyline.insert(bestIndex, node);
+
+	// Shrink or remove the nodes now covered by the new one
+	for (int i = bestIndex + 1; i < mSkyline.size(); i++) {
+		Node& next = mSkyline[i];
+		const int overlap = node.x + node.width - next.x;
+		if (overlap <= 0) break;
+		next.x += overlap;
+		next.width -= overlap;
+		if (next.width > 0) break;
+		mSkyline.remove(i--);
+	}
+
+	// Merge neighbours at the same height
+	for (int i = 0; i + 1 < mSkyline.size(); i++) {
+		if (mSkyline.at(i).y == mSkyline.at(i + 1).y) {
+			mSkyline[i].width += mSkyline.at(i + 1).width;
+			mSkyline.remove(i + 1);
+			i--;
+		}
+	}
+
+	*position = QPoint(node.x, bestY);
+	mUsedWidth = std::max(mUsedWidth, node.x + node.width);
+	mUsedHeight = std::max(mUsedHeight, node.y);
+	return true;
+}
+
+int NextPowerOfTwo(int value) {
+	int pot = 1;
+	while (pot < value) pot *= 2;
+	return pot;
+}
@@ -0,0 +1,39 @@
+#ifndef ATLASPACKER_H
+#define ATLASPACKER_H
+
+#include <QPoint>
+#include <QSize>
+#include <QVector>
+
+// Packs rectangles into a page with the skyline bottom-left heuristic.
+// Insert the largest rects first for the tightest packing.
+class SkylinePacker {
+public:
+	SkylinePacker(int width, int height);
+
+	// Returns false if size doesn't fit in the remaining space
+	bool insert(const QSize& size, QPoint* position);
+
+	// The bounding size of everything inserted so far
+	QSize usedSize() const { return { mUsedWidth, mUsedHeight }; }
+
+private:
+	struct Node {
+		int x;
+		int y;
+		int width;
+	};
+
+	int fit(int index, const QSize& size) const; // -1 if size doesn't fit at node index
+
+	QVector<Node> mSkyline;
+	int mWidth = 0;
+	int mHeight = 0;
+	int mUsedWidth = 0;
+	int mUsedHeight = 0;
+};
+
+// Smallest power of two >= value
+int NextPowerOfTwo(int value);
+
+#endif // ATLASPACKER_H
@@ -0,0 +1,125 @@
+#include "autosave.h"
+#include "projectmodel.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QStandardPaths>
+#include <QThread>
+
+static QString recoveryDir() {
+	return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+}
+
+static QString lockFileNameFor(const QString& recoveryFileName) {
+	return recoveryFileName + ".lock";
+}
+
+Autosave::Autosave(QObject *parent) :
+	QObject(parent)
+{
+	setProject(QString());
+}
+
+Autosave::~Autosave() {
+	wait();
+}
+
+QString Autosave::recoveryFileNameFor(const QString& projectFileName) {
+	// A new project isn't shared with other instances
+	if (projectFileName.isEmpty()) {
+		return QDir(recoveryDir()).filePath(QString("autosave-untitled-%1.mqs").arg(QCoreApplication::applicationPid()));
+	}
+	const QByteArray path = QFileInfo(projectFileName).absoluteFilePath().toUtf8();
+	const QString hash = QCryptographicHash::hash(path, QCryptographicHash::Sha1).toHex().left(16);
+	return QDir(recoveryDir()).filePath(QString("autosave-%1.mqs").arg(hash));
+}
+
+QStringList Autosave::orphanedRecoveryFiles() {
+	QStringList fileNames;
+	const QFileInfoList files = QDir(recoveryDir()).entryInfoList({ "autosave-*.mqs" }, QDir::Files, QDir::Time);
+	for (const auto& file : files) {
+		// A lock is only stale once the process that holds it is gone, however old it is
+		QLockFile lock(lockFileNameFor(file.absoluteFilePath()));
+		lock.setStaleLockTime(0);
+		if (lock.tryLock(0)) fileNames.append(file.absoluteFilePath());
+	}
+	return fileNames;
+}
+
+void Autosave::setProject(const QString& projectFileName) {
+	wait();
+	mLock.reset();
+
+	QDir().mkpath(recoveryDir());
+	mFileName = recoveryFileNameFor(projectFileName);
+	mLock.reset(new QLockFile(lockFileNameFor(mFileName)));
+	mLock->setStaleLockTime(0);
+	if (!mLock->tryLock(0)) {
+		// The project is open in another instance too
+		mFileName = QString("%1-%2.mqs").arg(mFileName.chopped(4)).arg(QCoreApplication::applicationPid());
+		mLock.reset(new QLockFile(lockFileNameFor(mFileName)));
+		mLock->setStaleLockTime(0);
+		if (!mLock->tryLock(0)) {
+			qWarning() << "Couldn't lock" << mFileName;
+		}
+	}
+}
+
+bool Autosave::hasRecoveryFile() const {
+	return QFile::exists(mFileName);
+}
+
+void Autosave::discardRecoveryFile() {
+	QFile::remove(mFileName);
+}
+
+bool Autosave::save(const ProjectModel& project) {
+	if (isRunning()) return false;
+
+	QElapsedTimer timer;
+	timer.start();
+	QSharedPointer<ProjectModel> snapshot = project.snapshot();
+	mSnapshotMs = timer.elapsed();
+
+	const QString fileName = recoveryFileName();
+	QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+	mThread = QThread::create([this, snapshot, fileName]() {
+		QElapsedTimer timer;
+		timer.start();
+		mSuccess = snapshot->saveCopy(fileName);
+		mWriteMs = timer.elapsed();
+		mBytesWritten = snapshot->lastSave.bytesWritten;
+		mError = snapshot->exportLog.mid(0, 10).join("\n");
+	});
+	const int run = ++mRun;
+	connect(mThread, &QThread::finished, this, [this, run]() {
+		if (mThread && mRun == run) threadFinished(); // unless wait() has handled it
+	});
+	mThread->start(QThread::LowPriority);
+	return true;
+}
+
+bool Autosave::isRunning() const {
+	return mThread != nullptr;
+}
+
+void Autosave::wait() {
+	if (mThread) {
+		mThread->wait();
+		threadFinished();
+	}
+}
+
+void Autosave::threadFinished() {
+	mThread->wait();
+	delete mThread;
+	mThread = nullptr;
+	emit finished(mSuccess, mSnapshotMs, mWriteMs, mBytesWritten, mError);
+}
@@ -0,0 +1,66 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <QObject>
+#include <QScopedPointer>
+#include <QString>
+#include <QStringList>
+
+class ProjectModel;
+class QLockFile;
+class QThread;
+
+// Saves the project to a recovery file without blocking the UI. A snapshot of the
+// project is taken on the UI thread, which is cheap as the frames share their pixels,
+// and it's written on a worker thread while editing carries on.
+// Each project has its own recovery file, which is locked while it's open, so several
+// instances of the editor don't overwrite each other's.
+class Autosave : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit Autosave(QObject *parent = nullptr);
+	~Autosave();
+
+	// The recovery file of the project saved as projectFileName, empty for a new project
+	static QString recoveryFileNameFor(const QString& projectFileName);
+
+	// The recovery files no running instance has open, i.e. left by ones that didn't close properly, newest first
+	static QStringList orphanedRecoveryFiles();
+
+	// Call this when the project's file name changes, the previous recovery file is left as it is
+	void setProject(const QString& projectFileName);
+	QString recoveryFileName() const { return mFileName; }
+	bool hasRecoveryFile() const;
+	void discardRecoveryFile();
+
+	// Returns false if an autosave is still running
+	bool save(const ProjectModel& project);
+	bool isRunning() const;
+
+	// Blocks until the running autosave has finished. Call this before the
+	// project is saved, loaded or cleared, as those replace its archive.
+	void wait();
+
+signals:
+	void finished(bool success, qint64 snapshotMs, qint64 writeMs, qint64 bytesWritten, const QString& error);
+
+private:
+	void threadFinished();
+
+	QString mFileName;
+	QScopedPointer<QLockFile> mLock;
+
+	QThread* mThread = nullptr;
+	int mRun = 0;
+	qint64 mSnapshotMs = 0;
+
+	// Written by the worker, read once it has finished
+	bool mSuccess = false;
+	qint64 mWriteMs = 0;
+	qint64 mBytesWritten = 0;
+	QString mError;
+};
+
+#endif // AUTOSAVE_H
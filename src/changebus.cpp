@@ -0,0 +1,107 @@
+#include "changebus.h"
+
+#include <utility>
+
+bool operator==(const ChangeBus::ModeKey& a, const ChangeBus::ModeKey& b) {
+	return a.part == b.part && a.mode == b.mode;
+}
+
+bool operator==(const ChangeBus::FrameKey& a, const ChangeBus::FrameKey& b) {
+	return a.part == b.part && a.frame == b.frame && a.mode == b.mode;
+}
+
+uint qHash(const ChangeBus::ModeKey& key) {
+	return qHash(key.part) ^ qHash(key.mode);
+}
+
+uint qHash(const ChangeBus::FrameKey& key) {
+	return qHash(key.part) ^ qHash(key.mode) ^ qHash(key.frame * 0x9E3779B1u);
+}
+
+bool ChangeBus::Changes::isEmpty() const {
+	return !assets && frames.isEmpty() && modeFrames.isEmpty() && pivots.isEmpty() && modes.isEmpty() &&
+		partProperties.isEmpty() && composites.isEmpty() && compositesMinor.isEmpty() && compProperties.isEmpty();
+}
+
+ChangeBus::ChangeBus(QObject *parent) :
+	QObject(parent)
+{
+}
+
+void ChangeBus::assetsChanged() {
+	mPending.assets = true;
+	schedule();
+}
+
+void ChangeBus::frameChanged(AssetRef part, const QString& mode, int frame, const QRect& rect) {
+	if (mPending.modeFrames.contains({ part, mode })) return;
+	auto it = mPending.frames.find({ part, mode, frame });
+	if (it == mPending.frames.end()) {
+		mPending.frames.insert({ part, mode, frame }, rect);
+	}
+	else if (!it->isNull()) {
+		*it = rect.isNull() ? QRect() : it->united(rect);
+	}
+	schedule();
+}
+
+void ChangeBus::framesChanged(AssetRef part, const QString& mode) {
+	for (auto it = mPending.frames.begin(); it != mPending.frames.end(); ) {
+		if (it.key().part == part && it.key().mode == mode) it = mPending.frames.erase(it);
+		else ++it;
+	}
+	mPending.modeFrames.insert({ part, mode });
+	schedule();
+}
+
+void ChangeBus::pivotsChanged(AssetRef part, const QString& mode) {
+	mPending.pivots.insert({ part, mode });
+	schedule();
+}
+
+void ChangeBus::modesChanged(AssetRef part) {
+	mPending.modes.insert(part);
+	schedule();
+}
+
+void ChangeBus::partPropertiesChanged(AssetRef part) {
+	mPending.partProperties.insert(part);
+	schedule();
+}
+
+void ChangeBus::compositeChanged(AssetRef comp, bool minor) {
+	if (!minor) {
+		mPending.compositesMinor.remove(comp);
+		mPending.composites.insert(comp);
+	}
+	else if (!mPending.composites.contains(comp)) {
+		mPending.compositesMinor.insert(comp);
+	}
+	schedule();
+}
+
+void ChangeBus::compPropertiesChanged(AssetRef comp) {
+	mPending.compProperties.insert(comp);
+	schedule();
+}
+
+void ChangeBus::flush() {
+	mScheduled = false;
+	if (mPending.isEmpty()) return;
+
+	// What the views do may post more changes, they're sent in the next turn
+	Changes changes;
+	std::swap(changes, mPending);
+	emit flushed(changes);
+}
+
+void ChangeBus::discard() {
+	mPending = Changes();
+}
+
+void ChangeBus::schedule() {
+	if (mScheduled) return;
+	mScheduled = true;
+	// NB: A posted call, not a timer, so it's handled before the (low priority) repaints
+	QMetaObject::invokeMethod(this, [this]() { flush(); }, Qt::QueuedConnection);
+}
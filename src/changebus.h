@@ -0,0 +1,76 @@
+#ifndef MMPIXEL_CHANGEBUS_H
+#define MMPIXEL_CHANGEBUS_H
+
+#include "projectmodel.h"
+
+#include <QHash>
+#include <QObject>
+#include <QRect>
+#include <QSet>
+#include <QString>
+
+// Collects what commands change in the project so the views are updated once per
+// event loop turn, however many commands ran in it. Changes are merged per asset,
+// mode and frame, and a change that implies another (e.g. a mode's frames being
+// replaced implies each of them was drawn on) replaces it. They're flushed before the
+// widgets repaint, as the flush is posted ahead of their update requests.
+class ChangeBus : public QObject
+{
+	Q_OBJECT
+
+public:
+	struct ModeKey {
+		AssetRef part;
+		QString mode;
+	};
+
+	struct FrameKey {
+		AssetRef part;
+		QString mode;
+		int frame;
+	};
+
+	struct Changes {
+		bool assets = false; // added, deleted, moved or renamed
+		QHash<FrameKey, QRect> frames; // drawn on within the rect, or all over if it's null
+		QSet<ModeKey> modeFrames; // frames added, removed or replaced
+		QSet<ModeKey> pivots; // the number of pivots changed
+		QSet<AssetRef> modes; // parts with modes added, removed, reset or resized
+		QSet<AssetRef> partProperties;
+		QSet<AssetRef> composites;
+		QSet<AssetRef> compositesMinor; // e.g. a child moved, redrawn without rebuilding the scene
+		QSet<AssetRef> compProperties;
+
+		bool isEmpty() const;
+	};
+
+	explicit ChangeBus(QObject *parent = nullptr);
+
+	void assetsChanged();
+	void frameChanged(AssetRef part, const QString& mode, int frame, const QRect& rect = QRect());
+	void framesChanged(AssetRef part, const QString& mode);
+	void pivotsChanged(AssetRef part, const QString& mode);
+	void modesChanged(AssetRef part);
+	void partPropertiesChanged(AssetRef part);
+	void compositeChanged(AssetRef comp, bool minor);
+	void compPropertiesChanged(AssetRef comp);
+
+	void flush(); // sends what's pending now instead of at the end of the turn
+	void discard(); // e.g. the project it refers to was closed
+
+signals:
+	void flushed(const ChangeBus::Changes& changes);
+
+private:
+	void schedule();
+
+	Changes mPending;
+	bool mScheduled = false;
+};
+
+bool operator==(const ChangeBus::ModeKey& a, const ChangeBus::ModeKey& b);
+bool operator==(const ChangeBus::FrameKey& a, const ChangeBus::FrameKey& b);
+uint qHash(const ChangeBus::ModeKey& key);
+uint qHash(const ChangeBus::FrameKey& key);
+
+#endif
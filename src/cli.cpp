@@ -0,0 +1,261 @@
+// mqsprite-cli runs the loading, saving and exporting of MQ Sprite without a GUI,
+// so projects can be exported by an asset pipeline. Each file gets its own
+// ProjectModel and the files are processed concurrently.
+
+#include "projectmodel.h"
+#include "parallel.h"
+#include "journal.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QVector>
+
+struct Options {
+	QString outDir;
+	bool atlas;
+	AtlasOptions atlasOptions;
+};
+
+struct Result {
+	bool success;
+	QStringList output; // printed in order once every file is done
+};
+
+static Result Failure(const QString& fileName, const QString& reason, const QList<QString>& log = {}) {
+	Result result { false, { fileName + ": " + reason } };
+	for (const auto& line : log) {
+		result.output.append("  " + line);
+	}
+	return result;
+}
+
+static bool LoadProject(ProjectModel& pm, const QString& fileName, Result* result) {
+	QString reason;
+	if (!pm.load(fileName, reason)) {
+		*result = Failure(fileName, "Couldn't load (" + reason + ")", pm.importLog);
+		return false;
+	}
+	// Edits that were quick saved in the editor are only in the journal
+	if (!Journal::replaySaved(&pm, reason)) {
+		*result = Failure(fileName, "Couldn't replay the journal (" + reason + ")");
+		return false;
+	}
+	return true;
+}
+
+// With several inputs each one is written to its own subdirectory of outDir
+static QString OutputPath(const Options& options, const QString& fileName, bool multipleInputs) {
+	if (!multipleInputs) return options.outDir;
+	return QDir(options.outDir).filePath(QFileInfo(fileName).completeBaseName());
+}
+
+static Result Export(const QString& fileName, const QString& outDir, const Options& options) {
+	Result result { true, {} };
+	ProjectModel pm;
+	if (!LoadProject(pm, fileName, &result)) return result;
+
+	if (!QDir().mkpath(outDir)) {
+		return Failure(fileName, "Couldn't create " + outDir);
+	}
+	const bool success = options.atlas ? pm.exportAtlas(outDir, options.atlasOptions) : pm.exportSimple(outDir);
+	if (!success) {
+		return Failure(fileName, "Couldn't export to " + outDir, pm.exportLog);
+	}
+	result.output.append(fileName + ": Exported to " + outDir);
+	for (const auto& line : pm.exportLog) {
+		result.output.append("  " + line);
+	}
+	return result;
+}
+
+static Result Repack(const QString& fileName, const QString& outFile) {
+	Result result { true, {} };
+	ProjectModel pm;
+	if (!LoadProject(pm, fileName, &result)) return result;
+
+	const qint64 oldSize = QFileInfo(fileName).size();
+	if (!pm.save(outFile)) {
+		return Failure(fileName, "Couldn't save " + outFile, pm.exportLog);
+	}
+	if (outFile == fileName) {
+		// The journal was written into the project
+		QFile::remove(Journal::fileNameFor(fileName));
+	}
+	const auto& stats = pm.lastSave;
+	result.output.append(QString("%1: Wrote %2 (%3 -> %4 bytes, %5 images encoded, %6 copied, %7 shared, %8ms)")
+		.arg(fileName, outFile).arg(oldSize).arg(stats.bytesWritten).arg(stats.imagesEncoded)
+		.arg(stats.imagesCopied).arg(stats.imagesShared).arg(stats.elapsedMs));
+	return result;
+}
+
+static Result Stats(const QString& fileName) {
+	Result result { true, {} };
+	ProjectModel pm;
+	if (!LoadProject(pm, fileName, &result)) return result;
+
+	int modes = 0;
+	int frames = 0;
+	for (const auto& part : pm.parts) {
+		modes += part->modes.size();
+		for (const auto& mode : part->modes) {
+			frames += mode.frames.size();
+		}
+	}
+	result.output.append(QString("%1: %2 bytes, %3 folders, %4 parts, %5 modes, %6 frames, %7 composites")
+		.arg(fileName).arg(QFileInfo(fileName).size()).arg(pm.folders.size()).arg(pm.parts.size())
+		.arg(modes).arg(frames).arg(pm.composites.size()));
+	return result;
+}
+
+// Loads the project and decodes every frame, which a lazy load doesn't do
+static Result Validate(const QString& fileName) {
+	Result result { true, {} };
+	ProjectModel pm;
+	if (!LoadProject(pm, fileName, &result)) return result;
+
+	struct Check {
+		QString name;
+		Frame frame;
+		QSize size;
+	};
+	QVector<Check> checks;
+	QStringList errors;
+	for (const auto& part : pm.parts) {
+		for (auto it = part->modes.begin(); it != part->modes.end(); ++it) {
+			const Part::Mode& mode = it.value();
+			const QString name = part->name + "/" + it.key();
+			if (mode.frames.size() != mode.numFrames || mode.anchor.size() != mode.numFrames) {
+				errors.append(QString("%1 has %2 frames and %3 anchors but should have %4").arg(name).arg(mode.frames.size()).arg(mode.anchor.size()).arg(mode.numFrames));
+			}
+			for (int i = 0; i < mode.frames.size(); i++) {
+				checks.append({ QString("%1 frame %2").arg(name).arg(i), mode.frames.at(i), QSize(mode.width, mode.height) });
+			}
+		}
+	}
+
+	QVector<QString> frameErrors(checks.size());
+	ParallelFor(checks.size(), [&](int i) {
+		const Check& check = checks.at(i);
+		if (check.frame.isNull() || check.frame->isNull()) {
+			frameErrors[i] = check.name + " couldn't be decoded";
+		}
+		else if (check.frame->size() != check.size) {
+			frameErrors[i] = QString("%1 is %2x%3 but the mode is %4x%5").arg(check.name)
+				.arg(check.frame->width()).arg(check.frame->height()).arg(check.size.width()).arg(check.size.height());
+		}
+	});
+	for (const auto& error : frameErrors) {
+		if (!error.isEmpty()) errors.append(error);
+	}
+
+	if (!errors.isEmpty()) {
+		return Failure(fileName, QString("%1 errors").arg(errors.size()), errors + pm.importLog);
+	}
+	result.output.append(fileName + QString(": OK (%1 frames)").arg(checks.size()));
+	for (const auto& line : pm.importLog) {
+		result.output.append("  " + line);
+	}
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication::setOrganizationName("Wizard Mode");
+	QCoreApplication::setOrganizationDomain("playmoonquest.com");
+	QCoreApplication::setApplicationName("mqsprite-cli");
+	QCoreApplication app(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Exports and inspects MQ Sprite projects without a GUI.\n\n"
+		"Commands:\n"
+		"  export    Export each project (data.json and images, or an atlas with --atlas)\n"
+		"  repack    Load and save each project again in the current format\n"
+		"  stats     Print the number of assets in each project\n"
+		"  validate  Check that each project loads and that every frame decodes");
+	parser.addHelpOption();
+	parser.addPositionalArgument("command", "export, repack, stats or validate");
+	parser.addPositionalArgument("files", "The .mqs files to process", "files...");
+
+	QCommandLineOption outOption({ "o", "out" }, "Output directory of export and repack (repack saves in place if it's not set)", "dir");
+	QCommandLineOption atlasOption("atlas", "export: Export texture atlases instead of one image per frame");
+	QCommandLineOption pageSizeOption("page-size", "export: Maximum atlas page size", "pixels", "2048");
+	QCommandLineOption paddingOption("padding", "export: Transparent pixels between atlas frames", "pixels", "1");
+	QCommandLineOption perFolderOption("pages-per-folder", "export: Pack the parts in each folder into their own pages");
+	QCommandLineOption jsonOption("json", "repack: Save data.json instead of the binary project data");
+	QCommandLineOption levelOption("level", "repack: Compression level of the project data (0-10)", "level", "6");
+	QCommandLineOption jobsOption({ "j", "jobs" }, "Number of threads (default: one per core)", "count");
+	parser.addOptions({ outOption, atlasOption, pageSizeOption, paddingOption, perFolderOption, jsonOption, levelOption, jobsOption });
+	parser.process(app);
+
+	QStringList args = parser.positionalArguments();
+	const QString command = args.isEmpty() ? QString() : args.takeFirst();
+	const QStringList files = args;
+	QTextStream err(stderr);
+	if (!QStringList({ "export", "repack", "stats", "validate" }).contains(command) || files.isEmpty()) {
+		err << parser.helpText();
+		return 2;
+	}
+
+	Options options;
+	options.outDir = parser.value(outOption);
+	options.atlas = parser.isSet(atlasOption);
+	options.atlasOptions.maxPageSize = parser.value(pageSizeOption).toInt();
+	options.atlasOptions.padding = qMax(0, parser.value(paddingOption).toInt());
+	options.atlasOptions.pagesPerFolder = parser.isSet(perFolderOption);
+	if (command == "export" && options.outDir.isEmpty()) {
+		err << "export requires an output directory (--out)\n";
+		return 2;
+	}
+	if (options.atlasOptions.maxPageSize <= 0) {
+		err << "Invalid page size " << parser.value(pageSizeOption) << "\n";
+		return 2;
+	}
+	if (command == "repack" && !options.outDir.isEmpty() && !QDir().mkpath(options.outDir)) {
+		err << "Couldn't create " << options.outDir << "\n";
+		return 2;
+	}
+
+	// Set before any worker starts, the preferences are only read after this
+	auto& prefs = GlobalPreferences();
+	prefs.lazyLoadFrames = true;
+	prefs.binaryProjectData = !parser.isSet(jsonOption);
+	prefs.compressionLevel = qBound(0, parser.value(levelOption).toInt(), 10);
+	if (parser.isSet(jobsOption)) {
+		QThreadPool::globalInstance()->setMaxThreadCount(qMax(1, parser.value(jobsOption).toInt()));
+	}
+
+	QVector<Result> results(files.size());
+	ParallelFor(files.size(), [&](int i) {
+		const QString& fileName = files.at(i);
+		if (command == "export") {
+			results[i] = Export(fileName, OutputPath(options, fileName, files.size() > 1), options);
+		}
+		else if (command == "repack") {
+			const QString outFile = options.outDir.isEmpty() ? fileName : QDir(options.outDir).filePath(QFileInfo(fileName).fileName());
+			results[i] = Repack(fileName, outFile);
+		}
+		else if (command == "stats") {
+			results[i] = Stats(fileName);
+		}
+		else {
+			results[i] = Validate(fileName);
+		}
+	});
+
+	QTextStream out(stdout);
+	int failed = 0;
+	for (const auto& result : results) {
+		(result.success ? out : err) << result.output.join("\n") << "\n";
+		if (!result.success) failed++;
+	}
+	out.flush();
+	if (failed > 0) {
+		err << failed << " of " << files.size() << " files failed\n";
+		return 1;
+	}
+	return 0;
+}
@@ -6,6 +6,19 @@
 static int sNewCompositeSuffix = 0;
 static int sNewModeSuffix = 0;
 
+// The frames of a mode, or of all the modes of a part, for heldFrames()
+static void AddFrames(QList<Frame*>& frames, Part::Mode& mode){
+    for (auto& frame: mode.frames){
+        if (frame) frames.append(&frame);
+    }
+}
+
+static void AddFrames(QList<Frame*>& frames, Part& part){
+    for (auto& mode: part.modes){
+        AddFrames(frames, mode);
+    }
+}
+
 bool TryCommand(Command* command){
     if (command->ok){
         MainWindow::Instance()->undoStack()->push(command);
@@ -24,19 +37,14 @@ CNewPart::CNewPart() {
 
 void CNewPart::undo()
 {
-    PM()->parts.take(mRef);
+    PM()->takePart(mRef);
     MainWindow::Instance()->partListChanged();
 }
 
 void CNewPart::redo()
 {
     // Find a unique name
-    QString name;
-    int number = 0;
-    do {
-        name = (number==0)?QString("sprite"):(QObject::tr("sprite_") + QString::number(number));
-        number++;
-    } while (PM()->findPartByName(name)!=nullptr);
+    QString name = PM()->uniqueName(AssetType::Part, "sprite");
 
     QSharedPointer<Part> part =  QSharedPointer<Part>::create();
     part->ref = mRef;
@@ -56,7 +64,7 @@ void CNewPart::redo()
 	mode.frames.push_back(img);
 
     part->modes.insert("icon", mode);
-    PM()->parts.insert(part->ref, part);
+    PM()->insertPart(part);
 
 	MainWindow::Instance()->newAssetCreated(part->ref);
 }
@@ -73,16 +81,14 @@ CCopyPart::CCopyPart(AssetRef ref){
 			suffix = part->name.right(part->name.size() - 1 - underscoreIndex).toInt();
 			prefix = part->name.left(underscoreIndex);
 		}
-        do {
-            mNewPartName = prefix + "_" + QString::number(++suffix);
-        } while (PM()->findPartByName(mNewPartName)!=nullptr);
+        mNewPartName = PM()->uniqueName(AssetType::Part, prefix, suffix + 1);
         mCopy = PM()->createAssetRef();
         mCopy.type = AssetType::Part;
     }
 }
 
 void CCopyPart::undo(){
-    PM()->parts.take(mCopy);
+    PM()->takePart(mCopy);
     MainWindow::Instance()->partListChanged();
 }
 
@@ -107,13 +113,13 @@ void CCopyPart::redo(){
             newMode.pivots[p] = mode.pivots[p];
 		newMode.frames.clear();
         newMode.numFrames = mode.numFrames;
-        for(auto oldImage: mode.frames){
-            auto img = QSharedPointer<QImage>::create(*oldImage);
-			newMode.frames.push_back(img);
+        // The copies share their pixels until one of them is drawn on
+        for(const auto& oldImage: mode.frames){
+			newMode.frames.push_back(PM()->sharedCopy(oldImage));
         }
         part->modes.insert(key, newMode);
     }
-    PM()->parts.insert(mCopy, part);    
+    PM()->insertPart(part);
 
 	MainWindow::Instance()->newAssetCreated(part->ref);
 }
@@ -124,50 +130,43 @@ CDeletePart::CDeletePart(AssetRef ref):mRef(ref),mCopy() {
 
 void CDeletePart::undo()
 {
-    PM()->parts.insert(mRef, mCopy);
+    PM()->insertPart(mCopy);
     MainWindow::Instance()->partListChanged();
 }
 
 void CDeletePart::redo()
 {
-    mCopy = PM()->parts.take(mRef);
+    mCopy = PM()->takePart(mRef);
     // MainWindow::Instance()->partListChanged();
 }
 
+void CDeletePart::heldFrames(QList<Frame*>& frames){
+    if (mCopy) AddFrames(frames, *mCopy);
+}
+
 CRenamePart::CRenamePart(AssetRef ref, QString newName):mRef(ref){
     ok = PM()->parts.contains(ref);
 
     // Find new name with newName as base
-    int num = 0;
-    do {
-        mNewName = (num==0)?newName:(newName + "_" + QString::number(num));
-        num++;
-    } while (PM()->findPartByName(mNewName)!=nullptr);
+    mNewName = PM()->uniqueName(AssetType::Part, newName);
 }
 
 void CRenamePart::undo(){
-    auto p = PM()->parts[mRef];
-    p->name = mOldName;
+    PM()->renameAsset(mRef, mOldName);
 
     MainWindow::Instance()->partRenamed(mRef, mOldName);
 }
 
 void CRenamePart::redo(){
-    auto p = PM()->parts[mRef];
-    mOldName = p->name;
-    p->name = mNewName;
+    mOldName = PM()->getPart(mRef)->name;
+    PM()->renameAsset(mRef, mNewName);
 
     MainWindow::Instance()->partRenamed(mRef, mNewName);
 }
 
 CNewComposite::CNewComposite() {
     // Find a name
-    int compSuffix = 0;
-    do {
-        mName = (compSuffix==0)?QString("comp"):(QObject::tr("comp_") + QString::number(compSuffix));
-        compSuffix++;
-    }
-    while (PM()->findCompositeByName(mName)!=nullptr);
+    mName = PM()->uniqueName(AssetType::Composite, "comp");
     mRef = PM()->createAssetRef();
     mRef.type = AssetType::Composite;
     ok = true;
@@ -175,7 +174,7 @@ CNewComposite::CNewComposite() {
 
 void CNewComposite::undo()
 {
-    PM()->composites.take(mRef);
+    PM()->takeComposite(mRef);
     MainWindow::Instance()->partListChanged();
 }
 
@@ -185,7 +184,7 @@ void CNewComposite::redo()
     comp->root = -1;
     comp->name = mName;
     comp->ref = mRef;
-    PM()->composites.insert(comp->ref, comp);
+    PM()->insertComposite(comp);
     MainWindow::Instance()->newAssetCreated(comp->ref);
 }
 
@@ -194,16 +193,12 @@ CCopyComposite::CCopyComposite(AssetRef ref){
     ok = (comp!=nullptr);
     if (ok){
         mOriginal = ref;
-        int copyNumber = 0;
-        do {
-            mNewCompositeName = comp->name + "_" + QString::number(copyNumber++);
-        }
-        while (PM()->findCompositeByName(mNewCompositeName)!=nullptr);
+        mNewCompositeName = PM()->uniqueName(AssetType::Composite, comp->name, 1);
     }
 }
 
 void CCopyComposite::undo(){
-    PM()->composites.take(mCopy);
+    PM()->takeComposite(mCopy);
     MainWindow::Instance()->partListChanged();
 }
 
@@ -220,7 +215,7 @@ void CCopyComposite::redo(){
     copy->properties = comp->properties;
     copy->children = comp->children;
     copy->childrenMap = comp->childrenMap;
-    PM()->composites.insert(copy->ref, copy);
+    PM()->insertComposite(copy);
 
     // MainWindow::Instance()->partListChanged();
 }
@@ -231,13 +226,13 @@ CDeleteComposite::CDeleteComposite(AssetRef ref): mRef(ref), mCopy(){
 
 void CDeleteComposite::undo()
 {
-    PM()->composites.insert(mRef, mCopy);
+    PM()->insertComposite(mCopy);
     MainWindow::Instance()->partListChanged();
 }
 
 void CDeleteComposite::redo()
 {
-    mCopy = PM()->composites.take(mRef);
+    mCopy = PM()->takeComposite(mRef);
 
     // MainWindow::Instance()->partListChanged();
 }
@@ -247,25 +242,18 @@ CRenameComposite::CRenameComposite(AssetRef ref, QString newName):mRef(ref),mNew
     ok = comp!=nullptr;
     if (ok){
         mOldName = comp->name;
-        int copyNumber = 0;
-        do {
-            mNewName = (copyNumber==0)?newName:(newName + "_" + QString::number(copyNumber));
-            copyNumber++;
-        }
-        while (PM()->findCompositeByName(mNewName)!=nullptr);
+        mNewName = PM()->uniqueName(AssetType::Composite, newName);
     }
 }
 
 void CRenameComposite::undo(){
-    Composite* p = PM()->getComposite(mRef);
-    p->name = mOldName;
+    PM()->renameAsset(mRef, mOldName);
 
     MainWindow::Instance()->compositeRenamed(mRef, mOldName);
 }
 
 void CRenameComposite::redo(){
-    Composite* p = PM()->getComposite(mRef);
-    p->name = mNewName;
+    PM()->renameAsset(mRef, mNewName);
 
     MainWindow::Instance()->compositeRenamed(mRef, mNewName);
 }
@@ -278,24 +266,19 @@ CNewFolder::CNewFolder() {
 
 void CNewFolder::undo()
 {
-    PM()->folders.take(mRef);
+    PM()->takeFolder(mRef);
     MainWindow::Instance()->partListChanged();
 }
 
 void CNewFolder::redo()
 {
     // Find a unique name
-    QString name;
-    int number = 0;
-    do {
-        name = (number==0)?QString("folder"):(QObject::tr("folder_") + QString::number(number));
-        number++;
-    } while (PM()->findFolderByName(name)!=nullptr);
+    QString name = PM()->uniqueName(AssetType::Folder, "folder");
 
     auto folder = QSharedPointer<Folder>::create();
     folder->ref = mRef;
     folder->name = name;
-    PM()->folders.insert(folder->ref, folder);
+    PM()->insertFolder(folder);
 
     MainWindow::Instance()->newAssetCreated(mRef);
 }
@@ -307,7 +290,7 @@ CDeleteFolder::CDeleteFolder(AssetRef ref):mRef(ref),mCopy() {
 void CDeleteFolder::undo()
 {
     qDebug() << "TODO: Undelete the folder contents";
-    PM()->folders.insert(mRef, mCopy);
+    PM()->insertFolder(mCopy);
 
     MainWindow::Instance()->partListChanged();
 }
@@ -315,7 +298,7 @@ void CDeleteFolder::undo()
 void CDeleteFolder::redo()
 {
     qDebug() << "TODO: Deleting the folder contents";
-    mCopy = PM()->folders.take(mRef);
+    mCopy = PM()->takeFolder(mRef);
 
     // MainWindow::Instance()->partListChanged();
 }
@@ -324,24 +307,18 @@ CRenameFolder::CRenameFolder(AssetRef ref, QString newName):mRef(ref){
     ok = PM()->folders.contains(ref);
 
     // Find new name with newName as base
-    int num = 0;
-    do {
-        mNewName = (num==0)?newName:(newName + "_" + QString::number(num));
-        num++;
-    } while (PM()->findFolderByName(mNewName)!=nullptr);
+    mNewName = PM()->uniqueName(AssetType::Folder, newName);
 }
 
 void CRenameFolder::undo(){
-    Folder* f = PM()->getFolder(mRef);
-    f->name = mOldName;
+    PM()->renameAsset(mRef, mOldName);
 
     MainWindow::Instance()->folderRenamed(mRef, mOldName);
 }
 
 void CRenameFolder::redo(){
-    Folder* f = PM()->getFolder(mRef);
-    mOldName = f->name;
-    f->name = mNewName;
+    mOldName = PM()->getFolder(mRef)->name;
+    PM()->renameAsset(mRef, mNewName);
 
     MainWindow::Instance()->folderRenamed(mRef, mNewName);
 }
@@ -358,36 +335,14 @@ CMoveAsset::CMoveAsset(AssetRef ref, AssetRef newParent):mRef(ref),mNewParent(ne
 
 void CMoveAsset::undo(){
     // Move the asset back
-    Asset* asset = PM()->getAsset(mRef);
-    asset->parent = mOldParent;
-
-    Folder* newParent = PM()->getFolder(mNewParent);
-    if (newParent){
-        newParent->children.removeAll(asset->parent);
-    }
-
-    Folder* oldParent = PM()->getFolder(mOldParent);
-    if (oldParent){
-        oldParent->children.append(asset->ref);
-    }
+    PM()->moveAsset(mRef, mOldParent);
 
     MainWindow::Instance()->partListChanged();
 }
 
 void CMoveAsset::redo(){
     // Move the asset
-    Asset* asset = PM()->getAsset(mRef);
-    asset->parent = mNewParent;
-
-    Folder* newParent = PM()->getFolder(mNewParent);
-    if (newParent){
-        newParent->children.append(asset->parent);
-    }
-
-    Folder* oldParent = PM()->getFolder(mOldParent);
-    if (oldParent){
-        oldParent->children.removeAll(asset->ref);
-    }
+    PM()->moveAsset(mRef, mNewParent);
 
     // NB: partListChanged() is called just once from PartList after all its moves are done
     // MainWindow::Instance()->partListChanged();
@@ -468,6 +423,10 @@ void CDeleteMode::redo(){
     MainWindow::Instance()->partModesChanged(mPart);
 }
 
+void CDeleteMode::heldFrames(QList<Frame*>& frames){
+    AddFrames(frames, mModeCopy);
+}
+
 
 CResetMode::CResetMode(AssetRef part, const QString& modeName):mPart(part),mModeName(modeName){
     // mModeCopy
@@ -512,6 +471,10 @@ void CResetMode::redo(){
     MainWindow::Instance()->partModesChanged(mPart);
 }
 
+void CResetMode::heldFrames(QList<Frame*>& frames){
+    AddFrames(frames, mModeCopy);
+}
+
 
 CCopyMode::CCopyMode(AssetRef part, const QString& modeName):mPart(part), mModeName(modeName){
     ok = PM()->hasPart(mPart) && PM()->getPart(mPart)->modes.contains(mModeName);
@@ -548,9 +511,8 @@ void CCopyMode::redo(){
     for(int p=0;p<Part::MaxPivots;p++)
         m.pivots[p] = copyMode.pivots[p];
     m.anchor = copyMode.anchor;
-    for(auto oldImage: copyMode.frames){
-        auto img = QSharedPointer<QImage>::create(*oldImage);
-        m.frames.push_back(img);
+    for(const auto& oldImage: copyMode.frames){
+        m.frames.push_back(PM()->sharedCopy(oldImage));
     }
     p->modes.insert(mNewModeName,m);
     MainWindow::Instance()->partModesChanged(mPart);
@@ -589,41 +551,94 @@ void CRenameMode::redo(){
 
 
 
+// The bounds of the pixels of image that aren't transparent, null if there are none
+static QRect OpaqueRect(const QImage& image){
+    const QImage argb = (image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_ARGB32_Premultiplied) ?
+                image : image.convertToFormat(QImage::Format_ARGB32);
+    int left = argb.width(), top = argb.height(), right = -1, bottom = -1;
+    for (int y = 0; y < argb.height(); y++){
+        const QRgb* line = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+        for (int x = 0; x < argb.width(); x++){
+            if (qAlpha(line[x]) > 0){
+                if (x < left) left = x;
+                if (x > right) right = x;
+                if (y < top) top = y;
+                if (y > bottom) bottom = y;
+            }
+        }
+    }
+    if (right < 0) return QRect();
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+// Crops a stroke to the pixels it can change, moving offset to match
+static void CropStroke(QImage& data, QPoint& offset){
+    const QRect rect = OpaqueRect(data);
+    if (rect.size() == data.size()) return;
+    data = rect.isNull() ? QImage() : data.copy(rect);
+    offset += rect.topLeft();
+}
+
+// Replaces the pixels of img at pos with pixels
+static void PastePixels(QImage* img, const Frame& pixels, const QPoint& pos){
+    if (!pixels) return;
+    QPainter painter(img);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(pos, *pixels);
+}
+
 CDrawOnPart::CDrawOnPart(AssetRef part, QString mode, int frame, QImage data, QPoint offset)
     :mPart(part),mMode(mode),mFrame(frame),mData(data),mOffset(offset){
     Part* p = PM()->getPart(mPart);
     ok = p &&
             p->modes.contains(mode) &&
             p->modes[mode].numFrames >= frame && // TODO: Check this
-            p->modes[mode].frames.at(frame)!=nullptr;
+            !p->modes[mode].frames.at(frame).isNull();
+    if (ok){
+        // Only the touched pixels are kept, old and new, instead of the whole frame twice
+        CropStroke(mData, mOffset);
+        const QImage& img = *p->modes[mode].frames.at(frame);
+        mRect = QRect(mOffset, mData.size()).intersected(img.rect());
+    }
 }
 
 void CDrawOnPart::undo(){
     //qDebug() << "CDrawOnPart::undo()";
-    // Reload the old frame
+    // Put back the old pixels
     auto img = PM()->getPart(mPart)->modes[mMode].frames.at(mFrame);
-    QPainter painter(img.data());
-    painter.setCompositionMode(QPainter::CompositionMode_Source);
-    painter.drawImage(0, 0, mOldFrame);
-    // *img = mOldFrame;
+    PastePixels(img.data(), mOldPixels, mRect.topLeft());
 
     // tell everyone that the part has been updated
-	PM()->resetImageCache(img.get());
-    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame);
+	PM()->resetImageCache(img);
+    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame, mRect);
 }
 
 void CDrawOnPart::redo(){
     //qDebug() << "CDrawOnPart::redo()";
-    // Record the old frame
-    // Draw the image into the part
     auto img = PM()->getPart(mPart)->modes[mMode].frames.at(mFrame);
-    mOldFrame = img->copy();
-    QPainter painter(img.data());
-    painter.drawImage(mOffset.x(), mOffset.y(), mData);
+    if (mNewPixels.isNull() && !mRect.isEmpty()){
+        // Record the old pixels
+        // Draw the image into the part
+        mOldPixels = Frame(QSharedPointer<QImage>::create(img->copy(mRect)));
+        {
+            QPainter painter(img.data());
+            painter.drawImage(mOffset.x(), mOffset.y(), mData);
+        }
+        mNewPixels = Frame(QSharedPointer<QImage>::create(img->copy(mRect)));
+        mData = QImage();
+    }
+    else {
+        PastePixels(img.data(), mNewPixels, mRect.topLeft());
+    }
 
     // tell everyone that the part has been updated
-	PM()->resetImageCache(img.get());
-    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame);
+	PM()->resetImageCache(img);
+    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame, mRect);
+}
+
+void CDrawOnPart::heldFrames(QList<Frame*>& frames){
+    if (mOldPixels) frames.append(&mOldPixels);
+    if (mNewPixels) frames.append(&mNewPixels);
 }
 
 CEraseOnPart::CEraseOnPart(AssetRef part, QString mode, int frame, QImage data, QPoint offset)
@@ -632,33 +647,50 @@ CEraseOnPart::CEraseOnPart(AssetRef part, QString mode, int frame, QImage data,
     ok = p &&
             p->modes.contains(mode) &&
             p->modes[mode].numFrames>=frame &&
-            p->modes[mode].frames.at(frame)!=nullptr;
+            !p->modes[mode].frames.at(frame).isNull();
+    if (ok){
+        CropStroke(mData, mOffset);
+        const QImage& img = *p->modes[mode].frames.at(frame);
+        mRect = QRect(mOffset, mData.size()).intersected(img.rect());
+    }
 }
 
 void CEraseOnPart::undo(){
-    // Reload the old frame
+    // Put back the old pixels
     auto img = PM()->getPart(mPart)->modes[mMode].frames.at(mFrame);
-    QPainter painter(img.data());
-    painter.drawImage(0, 0, mOldFrame);
-    // *img = mOldFrame;
+    PastePixels(img.data(), mOldPixels, mRect.topLeft());
 
     // tell everyone that the part has been updated
-	PM()->resetImageCache(img.get());
-    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame);
+	PM()->resetImageCache(img);
+    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame, mRect);
 }
 
 void CEraseOnPart::redo(){
-    // Record the old frame
-    // Draw the image into the part
     auto img = PM()->getPart(mPart)->modes[mMode].frames.at(mFrame);
-    mOldFrame = *img;
-    QPainter painter(img.data());
-    painter.setCompositionMode(QPainter::CompositionMode_DestinationOut);
-    painter.drawImage(mOffset.x(), mOffset.y(), mData);
+    if (mNewPixels.isNull() && !mRect.isEmpty()){
+        // Record the old pixels
+        // Erase the image from the part
+        mOldPixels = Frame(QSharedPointer<QImage>::create(img->copy(mRect)));
+        {
+            QPainter painter(img.data());
+            painter.setCompositionMode(QPainter::CompositionMode_DestinationOut);
+            painter.drawImage(mOffset.x(), mOffset.y(), mData);
+        }
+        mNewPixels = Frame(QSharedPointer<QImage>::create(img->copy(mRect)));
+        mData = QImage();
+    }
+    else {
+        PastePixels(img.data(), mNewPixels, mRect.topLeft());
+    }
 
     // tell everyone that the part has been updated
-	PM()->resetImageCache(img.get());
-    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame);
+	PM()->resetImageCache(img);
+    MainWindow::Instance()->partFrameUpdated(mPart, mMode, mFrame, mRect);
+}
+
+void CEraseOnPart::heldFrames(QList<Frame*>& frames){
+    if (mOldPixels) frames.append(&mOldPixels);
+    if (mNewPixels) frames.append(&mNewPixels);
 }
 
 
@@ -686,6 +718,10 @@ void CNewFrame::undo(){
     MainWindow::Instance()->partFramesUpdated(mPart, mModeName);
 }
 
+void CDeleteFrame::heldFrames(QList<Frame*>& frames){
+    if (mImage) frames.append(&mImage);
+}
+
 void CNewFrame::redo(){
     // Create the new frame
     auto part = PM()->getPart(mPart);
@@ -741,19 +777,21 @@ void CCopyFrame::redo(){
     Part* part = PM()->getPart(mPart);
     Part::Mode& mode = part->modes[mModeName];
 
-    auto image = QSharedPointer<QImage>();
+    // The copy shares its pixels until one of the frames is drawn on
+    Frame image;
     if (mIndex<mode.numFrames){
         mode.anchor.insert(mIndex+1, mode.anchor.at(mIndex));
-        image.reset(new QImage(mode.frames.at(mIndex)->copy()));
+        image = PM()->sharedCopy(mode.frames.at(mIndex));
     }
     else if (mode.numFrames>0){
         mode.anchor.insert(mIndex+1, mode.anchor.at(0));
-        image.reset(new QImage(mode.frames.at(0)->copy()));
+        image = PM()->sharedCopy(mode.frames.at(0));
     }
     else {
         mode.anchor.insert(mIndex+1, QPoint(0,0));
-        image.reset(new QImage(mode.width, mode.height, QImage::Format_ARGB32));
-        image->fill(0x00FFFFFF);
+        auto newImage = QSharedPointer<QImage>::create(mode.width, mode.height, QImage::Format_ARGB32);
+        newImage->fill(0x00FFFFFF);
+        image = Frame(newImage);
     }
     mode.frames.insert(mIndex+1, image);
 
@@ -790,7 +828,7 @@ void CDeleteFrame::undo(){
         mode.pivots[i].insert(mIndex, mPivots[i]);
     }
     mode.numFrames++;
-    mImage.clear();
+    mImage = Frame();
 
     MainWindow::Instance()->partFramesUpdated(mPart, mModeName);
 
@@ -922,6 +960,10 @@ void CChangeModeSize::redo(){
     MainWindow::Instance()->partModesChanged(mPart);
 }
 
+void CChangeModeSize::heldFrames(QList<Frame*>& frames){
+    AddFrames(frames, mOldMode);
+}
+
 CChangeModeFPS::CChangeModeFPS(AssetRef part, QString modeName, int fps)
     :mPart(part), mModeName(modeName), mFPS(fps){
     ok = PM()->hasPart(mPart) &&
@@ -1132,7 +1174,7 @@ CDeleteCompositeChild::CDeleteCompositeChild(AssetRef ref, const QString& childN
 
 void CDeleteCompositeChild::undo(){
     // Overwrite the old comp
-    PM()->composites.insert(mComp, mCompCopy);
+    PM()->insertComposite(mCompCopy);
     mCompCopy.clear();
     MainWindow::Instance()->compositeUpdated(mComp);
 }
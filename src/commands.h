@@ -12,6 +12,10 @@
 class Command: public QUndoCommand {
 public:
     bool ok; // is true if command can be processed    
+
+    // Adds the frames it keeps to be undone while it's done. They may be replaced
+    // with other handles to the same pixels, see UndoBudget.
+    virtual void heldFrames(QList<Frame*>& frames) { Q_UNUSED(frames); }
 };
 
 bool TryCommand(Command* command); // execute a command if its ok. takes ownership.
@@ -46,6 +50,7 @@ public:
     CDeletePart(AssetRef ref);
     void undo();
     void redo();
+    void heldFrames(QList<Frame*>& frames);
 
 private:
     AssetRef mRef;
@@ -182,6 +187,7 @@ public:
     CDeleteMode(AssetRef part, const QString& modeName);
     void undo();
     void redo();
+    void heldFrames(QList<Frame*>& frames);
 
 private:
     AssetRef mPart;
@@ -195,6 +201,7 @@ public:
     CResetMode(AssetRef part, const QString& modeName);
     void undo();
     void redo();
+    void heldFrames(QList<Frame*>& frames);
 
 private:
     AssetRef mPart;
@@ -238,13 +245,16 @@ public:
     CDrawOnPart(AssetRef part, QString mode, int frame, QImage data, QPoint offset);
     void undo();
     void redo();
+    void heldFrames(QList<Frame*>& frames);
 private:
     AssetRef mPart;
     QString mMode;
     int mFrame;
-    QImage mData;
+    QImage mData; // cropped to its opaque pixels, dropped once it's been drawn
     QPoint mOffset;
-    QImage mOldFrame;
+    QRect mRect; // the pixels of the frame it changes
+    Frame mOldPixels;
+    Frame mNewPixels;
 };
 
 class CEraseOnPart: public Command {
@@ -252,13 +262,16 @@ public:
     CEraseOnPart(AssetRef part, QString mode, int frame, QImage data, QPoint offset);
     void undo();
     void redo();
+    void heldFrames(QList<Frame*>& frames);
 private:
     AssetRef mPart;
     QString mMode;
     int mFrame;
-    QImage mData;
+    QImage mData; // cropped to its opaque pixels, dropped once it's been erased
     QPoint mOffset;
-    QImage mOldFrame;
+    QRect mRect; // the pixels of the frame it changes
+    Frame mOldPixels;
+    Frame mNewPixels;
 };
 
 
@@ -291,12 +304,13 @@ public:
     CDeleteFrame(AssetRef part, QString modeName, int index);
     void undo();
     void redo();
+    void heldFrames(QList<Frame*>& frames);
 
 private:
     AssetRef mPart;
     QString mModeName;
     int mIndex;
-    QSharedPointer<QImage> mImage;
+    Frame mImage;
     QPoint mAnchor;
     QPoint mPivots[Part::MaxPivots];
 };
@@ -338,6 +352,7 @@ public:
     CChangeModeSize(AssetRef part, QString modeName, int width, int height, int offsetX, int offsetY);
     void undo();
     void redo();
+    void heldFrames(QList<Frame*>& frames);
 
 private:
     AssetRef mPart;
@@ -507,47 +507,13 @@ void CompositeWidget::partNameChanged(AssetRef, const QString&){
     }
 }
 
-void CompositeWidget::partFrameUpdated(AssetRef part, const QString& /*mode*/, int /*frame*/){
-    QMutableMapIterator<QString,ChildDriver> it(mChildrenMap);
-    bool bingo = false;
-    while (it.hasNext()){
-        it.next();
-        ChildDriver& cd = it.value();
-        if (cd.part == part){
-            bingo = true;
-            break;
-        }
-    }
-
-    if (bingo) updateCompFramesMinorChanges();
-}
-
-void CompositeWidget::partFramesUpdated(AssetRef part, const QString&/* mode*/){
-    QMutableMapIterator<QString,ChildDriver> it(mChildrenMap);
-    bool bingo = false;
-    while (it.hasNext()){
-        it.next();
-        ChildDriver& cd = it.value();
-        if (cd.part == part){
-            bingo = true;
-            break;
-        }
-    }
-    if (bingo) updateCompFramesMinorChanges();
-}
-
-void CompositeWidget::partNumPivotsUpdated(AssetRef part, const QString& /*mode*/){
-    QMutableMapIterator<QString,ChildDriver> it(mChildrenMap);
-    bool bingo = false;
-    while (it.hasNext()){
-        it.next();
-        ChildDriver& cd = it.value();
-        if (cd.part == part){
-            bingo = true;
-            break;
+void CompositeWidget::partsUpdated(const QSet<AssetRef>& parts){
+    for (const ChildDriver& cd: mChildrenMap){
+        if (parts.contains(cd.part)){
+            updateCompFramesMinorChanges();
+            return;
         }
     }
-    if (bingo) updateCompFramesMinorChanges();
 }
 
 void CompositeWidget::setZoom(int z){
@@ -7,6 +7,7 @@
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QImage>
+#include <QSet>
 #include <QVector>
 #include <QGraphicsPixmapItem>
 #include <QGraphicsRectItem>
@@ -47,9 +48,7 @@ public:
 
     // part updates..
     void partNameChanged(AssetRef part, const QString& newPartName);
-    void partFrameUpdated(AssetRef part, const QString& mode, int frame);
-    void partFramesUpdated(AssetRef part, const QString& mode);
-    void partNumPivotsUpdated(AssetRef part, const QString& mode);
+    void partsUpdated(const QSet<AssetRef>& parts); // their frames or pivots changed
 
     // TODO: comp updates
     void compNameChanged(AssetRef ref);
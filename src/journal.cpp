@@ -0,0 +1,741 @@
+#include "journal.h"
+
+#include "zip.h"
+#include "xxhash.h"
+#include <QBuffer>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+#include <QPainter>
+
+static const quint32 JournalMagic = 0x4A53514D; // "MQSJ"
+static const quint32 JournalVersion = 1;
+
+enum BlockKind : quint8 {
+	StepBlock = 1,
+	SavedBlock = 2,
+};
+
+enum RecordType : quint8 {
+	FrameImageRecord = 1, // the pixels of a frame, or of the rect of it that changed
+	FrameRecord = 2, // which frame is at an index of a mode, and its anchor and pivots
+	PartRecord = 3,
+	CompositeRecord = 4,
+	FolderRecord = 5,
+	RemoveRecord = 6,
+};
+
+static void setupStream(QDataStream& stream) {
+	stream.setVersion(QDataStream::Qt_5_0);
+	stream.setByteOrder(QDataStream::LittleEndian);
+}
+
+static qint32 journalRef(const AssetRef& ref) {
+	return ref.isNull() ? -1 : ref.id;
+}
+
+static AssetRef makeRef(qint32 id, AssetType type) {
+	AssetRef ref;
+	if (id >= 0) {
+		ref.id = id;
+		ref.type = type;
+	}
+	return ref;
+}
+
+static QString readString(QDataStream& in) {
+	QByteArray str;
+	in >> str;
+	return QString::fromUtf8(str);
+}
+
+struct JournalBlock {
+	quint8 kind;
+	QByteArray payload;
+	qint64 end; // file position after the block
+};
+
+// Reads the blocks after the header up to the first incomplete or corrupt one, e.g. cut off by a crash
+static QList<JournalBlock> readBlocks(QFile& file, qint64 start) {
+	QList<JournalBlock> blocks;
+	file.seek(start);
+	QDataStream in(&file);
+	setupStream(in);
+	while (!in.atEnd()) {
+		JournalBlock block;
+		quint64 hash = 0;
+		in >> block.kind >> block.payload >> hash;
+		if (in.status() != QDataStream::Ok) break;
+		if (block.kind != StepBlock && block.kind != SavedBlock) break;
+		if (hash != XXH64(block.payload.constData(), (size_t) block.payload.size())) break;
+		block.end = file.pos();
+		blocks.append(block);
+	}
+	return blocks;
+}
+
+Journal::~Journal() {
+	// Leaves the file as it is, so the unsaved steps can be recovered if this is a crash
+	mFile.close();
+}
+
+QString Journal::fileNameFor(const QString& projectFileName) {
+	return projectFileName + ".journal";
+}
+
+void Journal::reset() {
+	mProject = nullptr;
+	mSavedEnd = HeaderSize;
+	mPending = ReplayState();
+	mParts.clear();
+	mComposites.clear();
+	mFolders.clear();
+	mFrames.clear();
+	mAssetsChanged = false;
+	mParents.clear();
+	mFrameIds.clear();
+	mFrameKeys.clear();
+	mDirty.clear();
+	mNextFrameId = 1;
+}
+
+bool Journal::start(ProjectModel* project) {
+	mFile.close();
+	reset();
+	if (project->fileName.isEmpty()) return false;
+
+	const QFileInfo info(project->fileName);
+	mFile.setFileName(fileNameFor(project->fileName));
+	if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qWarning() << "Couldn't create" << mFile.fileName() << mFile.errorString();
+		return false;
+	}
+
+	// The journal only applies to the project file as it is now
+	QDataStream out(&mFile);
+	setupStream(out);
+	out << JournalMagic << JournalVersion << (qint64) info.size() << (qint64) info.lastModified().toMSecsSinceEpoch();
+	mFile.flush();
+
+	mProject = project;
+	adoptReplayed(ReplayState());
+	return true;
+}
+
+// Renames fileName to the first free name with suffix (and a number), and returns it, or an empty string if it couldn't be renamed
+QString Journal::keepAside(const QString& fileName, const QString& suffix) {
+	QString kept = fileName + suffix;
+	for (int i = 2; QFile::exists(kept); i++) {
+		kept = fileName + suffix + QString::number(i);
+	}
+	if (!QFile::rename(fileName, kept)) {
+		qWarning() << "Couldn't rename" << fileName << "to" << kept;
+		return {};
+	}
+	return kept;
+}
+
+// Undoes what was replayed of the journal by loading the project file again
+bool Journal::reloadProject(ProjectModel* project, QString& reason) {
+	reset();
+	const QString fileName = project->fileName;
+	QString loadReason;
+	if (!project->load(fileName, loadReason)) {
+		project->clear();
+		reason += "\nCouldn't reload " + fileName + ": " + loadReason;
+		return false;
+	}
+	return true;
+}
+
+bool Journal::readHeader(QFile& file, const QString& projectFileName) {
+	const QFileInfo info(projectFileName);
+	QDataStream in(&file);
+	setupStream(in);
+	file.seek(0);
+	quint32 magic = 0, version = 0;
+	qint64 size = 0, modified = 0;
+	in >> magic >> version >> size >> modified;
+	return in.status() == QDataStream::Ok && magic == JournalMagic && version == JournalVersion &&
+		size == info.size() && modified == info.lastModified().toMSecsSinceEpoch();
+}
+
+bool Journal::resume(ProjectModel* project, int* unsavedSteps, QString& reason) {
+	mFile.close();
+	reset();
+	*unsavedSteps = 0;
+
+	const QString fileName = fileNameFor(project->fileName);
+	if (!QFile::exists(fileName)) {
+		start(project);
+		return true;
+	}
+
+	mFile.setFileName(fileName);
+	if (!mFile.open(QIODevice::ReadWrite)) {
+		reason = "Couldn't open " + fileName + ": " + mFile.errorString();
+		return false;
+	}
+	if (!readHeader(mFile, project->fileName)) {
+		// E.g. the project file was copied or synced since, the journal may still have the only copy of edits
+		mFile.close();
+		const QString kept = keepAside(fileName, ".old");
+		reason = fileName + " belongs to a different version of the project, so its edits weren't restored.";
+		if (!kept.isEmpty()) reason += "\nIt was kept as " + kept;
+		start(project);
+		return false;
+	}
+
+	const QList<JournalBlock> blocks = readBlocks(mFile, HeaderSize);
+	ReplayState state;
+	for (const auto& block : blocks) {
+		if (block.kind == SavedBlock) state.savedEnd = block.end;
+		state.end = block.end;
+	}
+	for (const auto& block : blocks) {
+		if (block.kind != StepBlock) continue;
+		if (block.end <= state.savedEnd) {
+			if (!applyStep(block.payload, project, &state)) {
+				mFile.close();
+				const QString kept = keepAside(fileName, ".bad");
+				reason = fileName + " is corrupt, so its edits weren't restored.";
+				if (!kept.isEmpty()) reason += "\nIt was kept as " + kept;
+
+				// Some of the steps were applied already
+				if (!reloadProject(project, reason)) return false;
+				start(project);
+				return false;
+			}
+		}
+		else {
+			state.unsaved.append(block.payload);
+		}
+	}
+
+	// Drop anything after the last complete step, e.g. a step cut off by a crash
+	mFile.resize(state.end);
+	mProject = project;
+	mSavedEnd = state.savedEnd;
+	adoptReplayed(state);
+	mPending = state;
+	*unsavedSteps = state.unsaved.size();
+	return true;
+}
+
+bool Journal::replayUnsaved(QString& reason) {
+	if (!mProject) return true;
+	for (const auto& step : mPending.unsaved) {
+		if (!applyStep(step, mProject, &mPending)) {
+			// Keep a copy with the unsaved steps, and go back to the saved ones
+			ProjectModel* project = mProject;
+			const QString fileName = mFile.fileName();
+			mFile.close();
+			const QString kept = keepAside(fileName, ".bad");
+			if (!kept.isEmpty()) QFile::copy(kept, fileName);
+			reason = "Some of the unsaved edits in " + fileName + " are corrupt, so none of them were restored.";
+			if (!kept.isEmpty()) reason += "\nThe journal was kept as " + kept;
+
+			// Some of them were applied already
+			if (!reloadProject(project, reason)) return false;
+			int unsavedSteps = 0;
+			QString resumeReason;
+			if (resume(project, &unsavedSteps, resumeReason)) discardUnsaved();
+			else reason += "\n" + resumeReason;
+			return false;
+		}
+	}
+	mPending.unsaved.clear();
+	adoptReplayed(mPending);
+	return true;
+}
+
+void Journal::discardUnsaved() {
+	if (!mProject) return;
+	mPending.unsaved.clear();
+	mFile.resize(mSavedEnd);
+}
+
+void Journal::stop(bool discard) {
+	if (mFile.isOpen()) {
+		if (!discard && mSavedEnd > HeaderSize) {
+			mFile.resize(mSavedEnd);
+			mFile.close();
+		}
+		else {
+			mFile.close();
+			mFile.remove();
+		}
+	}
+	reset();
+}
+
+// Takes over the frames created by replaying, and starts tracking changes from the current state
+void Journal::adoptReplayed(const ReplayState& state) {
+	for (auto it = state.frames.begin(); it != state.frames.end(); ++it) {
+		const Frame& frame = it.value();
+		if (!mFrameIds.contains(frame.d.data())) mFrameIds.insert(frame.d.data(), { it.key(), frame.d });
+		mFrameKeys.insert(it.key(), frame.isLoaded() ? frame->cacheKey() : 0);
+		mNextFrameId = qMax(mNextFrameId, it.key() + 1);
+	}
+
+	mParents.clear();
+	for (const auto& part : mProject->parts) mParents.insert(part->ref, part->parent);
+	for (const auto& comp : mProject->composites) mParents.insert(comp->ref, comp->parent);
+	for (const auto& folder : mProject->folders) mParents.insert(folder->ref, folder->parent);
+}
+
+void Journal::partChanged(AssetRef ref) {
+	if (mProject) mParts.insert(ref);
+}
+
+void Journal::frameChanged(AssetRef part, const QString& mode, int frame, const QRect& rect) {
+	if (mProject) mFrames.append({ part, mode, frame, rect });
+}
+
+void Journal::compositeChanged(AssetRef ref) {
+	if (mProject) mComposites.insert(ref);
+}
+
+void Journal::folderChanged(AssetRef ref) {
+	if (mProject) mFolders.insert(ref);
+}
+
+void Journal::assetsChanged() {
+	if (mProject) mAssetsChanged = true;
+}
+
+// Writes the pixels of frame if they've changed since they were last written, and returns its id
+quint32 Journal::writeFrame(QDataStream& out, const Frame& frame) {
+	if (frame.isNull()) return 0;
+
+	Frame::Data* data = frame.d.data();
+	// An expired entry is a freed frame whose address has been reused
+	auto known = mFrameIds.find(data);
+	const bool isNew = (known == mFrameIds.end() || known->data.isNull());
+	if (isNew) {
+		if (known != mFrameIds.end()) mFrameKeys.remove(known->id);
+		known = mFrameIds.insert(data, { mNextFrameId++, frame.d });
+	}
+	const quint32 id = known->id;
+
+	if (!frame.isLoaded()) {
+		// Not decoded so it hasn't been drawn on, copy its encoded image the first time
+		if (!isNew) return id;
+		QByteArray png;
+		{
+			QMutexLocker lock(&data->mutex);
+			if (!data->image) {
+				png = data->png;
+				if (png.isNull() && data->archive) png = data->archive->read(data->entry);
+			}
+		}
+		if (!png.isNull()) {
+			out << (quint8) FrameImageRecord << id << QRect() << png;
+			mFrameKeys.insert(id, 0);
+			return id;
+		}
+	}
+
+	// NB: Only the key of the pixels is kept, a copy of them would make the next stroke copy the whole frame
+	const QImage& image = *frame;
+	auto key = mFrameKeys.find(id);
+	if (key != mFrameKeys.end() && *key == image.cacheKey()) return id;
+
+	// Only the rect commands reported drawn on, or all of the pixels (a null rect) the first time
+	QRect rect;
+	if (key != mFrameKeys.end()) {
+		auto dirty = mDirty.constFind(data);
+		if (dirty == mDirty.constEnd() && *key == 0) {
+			// Decoded since it was written, but not drawn on
+			*key = image.cacheKey();
+			return id;
+		}
+		if (dirty != mDirty.constEnd() && !dirty->isNull()) {
+			rect = dirty->intersected(image.rect());
+			if (rect.isEmpty()) {
+				*key = image.cacheKey();
+				return id;
+			}
+		}
+	}
+
+	QByteArray png;
+	QBuffer buffer(&png);
+	buffer.open(QIODevice::WriteOnly);
+	(rect.isNull() ? image : image.copy(rect)).save(&buffer, "PNG");
+	out << (quint8) FrameImageRecord << id << rect << png;
+	mFrameKeys.insert(id, image.cacheKey());
+	return id;
+}
+
+void Journal::writePart(QDataStream& out, const Part& part) {
+	// The part refers to its frames by id, so they're written first
+	QList<QList<quint32>> frameIds;
+	for (const auto& mode : part.modes) {
+		QList<quint32> ids;
+		for (const auto& frame : mode.frames) {
+			ids.append(writeFrame(out, frame));
+		}
+		frameIds.append(ids);
+	}
+
+	out << (quint8) PartRecord << (qint32) part.ref.id << journalRef(part.parent) << part.name.toUtf8() << part.properties.toUtf8();
+	out << (quint32) part.modes.size();
+	int index = 0;
+	for (auto it = part.modes.begin(); it != part.modes.end(); ++it, ++index) {
+		const Part::Mode& m = it.value();
+		out << it.key().toUtf8();
+		out << (qint32) m.width << (qint32) m.height << (qint32) m.numFrames << (qint32) m.numPivots << (qint32) m.framesPerSecond;
+		out << frameIds.at(index) << m.anchor;
+		for (int p = 0; p < Part::MaxPivots; p++) {
+			out << m.pivots[p];
+		}
+	}
+}
+
+bool Journal::flush() {
+	if (!mProject) return false;
+	if (!mAssetsChanged && mParts.isEmpty() && mComposites.isEmpty() && mFolders.isEmpty() && mFrames.isEmpty()) return true;
+
+	// Forget the frames that have been freed since the last step
+	for (auto it = mFrameIds.begin(); it != mFrameIds.end();) {
+		if (!it->data.isNull()) { ++it; continue; }
+		mFrameKeys.remove(it->id);
+		it = mFrameIds.erase(it);
+	}
+
+	// The rects drawn on, by frame, which may have been drawn on several times
+	for (const auto& f : mFrames) {
+		const Part* part = mProject->getPart(f.part);
+		if (!part || !part->modes.contains(f.mode)) continue;
+		const Part::Mode& m = part->modes[f.mode];
+		if (f.frame < 0 || f.frame >= m.frames.size() || m.frames.at(f.frame).isNull()) continue;
+		Frame::Data* data = m.frames.at(f.frame).d.data();
+		auto dirty = mDirty.find(data);
+		if (dirty == mDirty.end()) mDirty.insert(data, f.rect);
+		else if (!dirty->isNull()) *dirty = f.rect.isNull() ? QRect() : dirty->united(f.rect);
+	}
+
+	QByteArray step;
+	QDataStream out(&step, QIODevice::WriteOnly);
+	setupStream(out);
+	out << (qint32) mProject->mNextId;
+
+	if (mAssetsChanged) {
+		for (auto it = mParents.begin(); it != mParents.end();) {
+			const AssetRef ref = it.key();
+			if (!mProject->hasAsset(ref)) {
+				out << (quint8) RemoveRecord << (quint8) ref.type << (qint32) ref.id;
+				it = mParents.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+
+		// New and moved assets are written in full
+		auto check = [&](const Asset& asset, QSet<AssetRef>& changed) {
+			if (!mParents.contains(asset.ref) || mParents.value(asset.ref) != asset.parent) {
+				changed.insert(asset.ref);
+			}
+		};
+		for (const auto& folder : mProject->folders) check(*folder, mFolders);
+		for (const auto& part : mProject->parts) check(*part, mParts);
+		for (const auto& comp : mProject->composites) check(*comp, mComposites);
+	}
+
+	for (const auto& ref : mFolders) {
+		const Folder* folder = mProject->getFolder(ref);
+		if (!folder) continue;
+		out << (quint8) FolderRecord << (qint32) folder->ref.id << journalRef(folder->parent) << folder->name.toUtf8();
+		mParents.insert(ref, folder->parent);
+	}
+
+	for (const auto& ref : mParts) {
+		const Part* part = mProject->getPart(ref);
+		if (!part) continue;
+		writePart(out, *part);
+		mParents.insert(ref, part->parent);
+	}
+
+	for (const auto& ref : mComposites) {
+		const Composite* comp = mProject->getComposite(ref);
+		if (!comp) continue;
+		out << (quint8) CompositeRecord << (qint32) comp->ref.id << journalRef(comp->parent) << comp->name.toUtf8() << comp->properties.toUtf8();
+		out << (qint32) comp->root << (quint32) comp->children.size();
+		for (const auto& childName : comp->children) {
+			const auto& child = comp->childrenMap.value(childName);
+			out << childName.toUtf8();
+			out << (qint32) child.id << journalRef(child.part) << (qint32) child.parent << (qint32) child.parentPivot << (qint32) child.z;
+			out << (quint32) child.children.size();
+			for (int ci : child.children) {
+				out << (qint32) ci;
+			}
+		}
+		mParents.insert(ref, comp->parent);
+	}
+
+	// Frames that were drawn on, or whose anchor or pivots moved
+	for (const auto& f : mFrames) {
+		if (mParts.contains(f.part)) continue; // written in full already
+		const Part* part = mProject->getPart(f.part);
+		if (!part || !part->modes.contains(f.mode)) continue;
+		const Part::Mode& m = part->modes[f.mode];
+		if (f.frame < 0 || f.frame >= m.frames.size() || f.frame >= m.anchor.size()) continue;
+
+		const quint32 id = writeFrame(out, m.frames.at(f.frame));
+		out << (quint8) FrameRecord << (qint32) part->ref.id << f.mode.toUtf8() << (qint32) f.frame << id << m.anchor.at(f.frame);
+		for (int p = 0; p < Part::MaxPivots; p++) {
+			out << (f.frame < m.pivots[p].size() ? m.pivots[p].at(f.frame) : QPoint());
+		}
+	}
+
+	mParts.clear();
+	mComposites.clear();
+	mFolders.clear();
+	mFrames.clear();
+	mDirty.clear();
+	mAssetsChanged = false;
+	return appendBlock(StepBlock, step);
+}
+
+bool Journal::markSaved() {
+	if (!mProject || !appendBlock(SavedBlock, {})) return false;
+	mSavedEnd = mFile.size();
+	return true;
+}
+
+bool Journal::appendBlock(quint8 kind, const QByteArray& payload) {
+	QByteArray block;
+	QDataStream out(&block, QIODevice::WriteOnly);
+	setupStream(out);
+	out << kind << payload << (quint64) XXH64(payload.constData(), (size_t) payload.size());
+
+	mFile.seek(mFile.size());
+	if (mFile.write(block) != block.size() || !mFile.flush()) {
+		qWarning() << "Couldn't write to" << mFile.fileName() << mFile.errorString();
+		return false;
+	}
+	return true;
+}
+
+bool Journal::applyStep(const QByteArray& step, ProjectModel* project, ReplayState* state) {
+	QDataStream in(step);
+	setupStream(in);
+
+	qint32 nextId = 0;
+	in >> nextId;
+	project->mNextId = qMax(project->mNextId, (int) nextId);
+	project->invalidateIndexes(); // the records replace assets directly
+
+	while (!in.atEnd() && in.status() == QDataStream::Ok) {
+		quint8 type = 0;
+		in >> type;
+		switch (type) {
+		case FrameImageRecord: {
+			quint32 id = 0;
+			QRect rect;
+			QByteArray png;
+			in >> id >> rect >> png;
+			Frame frame = state->frames.value(id);
+			if (rect.isNull()) {
+				if (frame.isNull()) {
+					// Decoded when it's first used, like a frame in the project file
+					frame.d = QSharedPointer<Frame::Data>::create();
+					frame.d->png = png;
+					state->frames.insert(id, frame);
+				}
+				else {
+					// Replace the pixels of the frame the parts refer to
+					QImage image;
+					image.loadFromData(png, "PNG");
+					*frame = image;
+				}
+			}
+			else {
+				if (frame.isNull()) return false;
+				QImage patch;
+				patch.loadFromData(png, "PNG");
+				QImage& image = *frame;
+				if (image.depth() < 32) image = image.convertToFormat(QImage::Format_ARGB32);
+				QPainter painter(&image);
+				painter.setCompositionMode(QPainter::CompositionMode_Source);
+				painter.drawImage(rect.topLeft(), patch);
+			}
+			break;
+		}
+		case FrameRecord: {
+			qint32 partId = -1, index = -1;
+			quint32 id = 0;
+			QPoint anchor;
+			QPoint pivots[Part::MaxPivots];
+			in >> partId;
+			const QString mode = readString(in);
+			in >> index >> id >> anchor;
+			for (int p = 0; p < Part::MaxPivots; p++) in >> pivots[p];
+
+			Part* part = project->getPart(makeRef(partId, AssetType::Part));
+			if (!part || !part->modes.contains(mode)) break;
+			Part::Mode& m = part->modes[mode];
+			if (index < 0 || index >= m.frames.size() || index >= m.anchor.size()) break;
+			if (id != 0) {
+				if (!state->frames.contains(id)) return false;
+				m.frames[index] = state->frames.value(id);
+			}
+			m.anchor[index] = anchor;
+			for (int p = 0; p < Part::MaxPivots; p++) {
+				if (index < m.pivots[p].size()) m.pivots[p][index] = pivots[p];
+			}
+			break;
+		}
+		case PartRecord: {
+			auto part = QSharedPointer<Part>::create();
+			qint32 id = -1, parent = -1;
+			in >> id >> parent;
+			part->ref = makeRef(id, AssetType::Part);
+			part->parent = makeRef(parent, AssetType::Folder);
+			part->name = readString(in);
+			part->properties = readString(in);
+			quint32 numModes = 0;
+			in >> numModes;
+			for (quint32 i = 0; i < numModes && in.status() == QDataStream::Ok; i++) {
+				const QString name = readString(in);
+				Part::Mode m;
+				qint32 width = 0, height = 0, numFrames = 0, numPivots = 0, fps = 0;
+				in >> width >> height >> numFrames >> numPivots >> fps;
+				m.width = width;
+				m.height = height;
+				m.numFrames = numFrames;
+				m.numPivots = numPivots;
+				m.framesPerSecond = fps;
+				QList<quint32> frameIds;
+				in >> frameIds >> m.anchor;
+				for (int p = 0; p < Part::MaxPivots; p++) {
+					in >> m.pivots[p];
+				}
+				for (quint32 frameId : frameIds) {
+					if (frameId != 0 && !state->frames.contains(frameId)) return false;
+					m.frames.append(state->frames.value(frameId));
+				}
+				part->modes.insert(name, m);
+			}
+			if (id < 0) return false;
+			project->parts.insert(part->ref, part);
+			break;
+		}
+		case CompositeRecord: {
+			auto comp = QSharedPointer<Composite>::create();
+			qint32 id = -1, parent = -1, root = -1;
+			in >> id >> parent;
+			comp->ref = makeRef(id, AssetType::Composite);
+			comp->parent = makeRef(parent, AssetType::Folder);
+			comp->name = readString(in);
+			comp->properties = readString(in);
+			quint32 numChildren = 0;
+			in >> root >> numChildren;
+			comp->root = root;
+			for (quint32 i = 0; i < numChildren && in.status() == QDataStream::Ok; i++) {
+				const QString name = readString(in);
+				Composite::Child child;
+				qint32 childId = -1, part = -1, childParent = -1, parentPivot = -1, z = 0;
+				quint32 numChildrenOfChild = 0;
+				in >> childId >> part >> childParent >> parentPivot >> z >> numChildrenOfChild;
+				child.id = childId;
+				child.part = makeRef(part, AssetType::Part);
+				child.index = (int) i;
+				child.parent = childParent;
+				child.parentPivot = parentPivot;
+				child.z = z;
+				for (quint32 c = 0; c < numChildrenOfChild && in.status() == QDataStream::Ok; c++) {
+					qint32 ci = -1;
+					in >> ci;
+					child.children.append(ci);
+				}
+				comp->children.append(name);
+				comp->childrenMap.insert(name, child);
+			}
+			if (id < 0) return false;
+			project->composites.insert(comp->ref, comp);
+			break;
+		}
+		case FolderRecord: {
+			auto folder = QSharedPointer<Folder>::create();
+			qint32 id = -1, parent = -1;
+			in >> id >> parent;
+			folder->ref = makeRef(id, AssetType::Folder);
+			folder->parent = makeRef(parent, AssetType::Folder);
+			folder->name = readString(in);
+			if (id < 0) return false;
+			project->folders.insert(folder->ref, folder);
+			break;
+		}
+		case RemoveRecord: {
+			quint8 assetType = 0;
+			qint32 id = -1;
+			in >> assetType >> id;
+			const AssetRef ref = makeRef(id, (AssetType) assetType);
+			switch (ref.type) {
+			case AssetType::Part: project->parts.remove(ref); break;
+			case AssetType::Composite: project->composites.remove(ref); break;
+			case AssetType::Folder: project->folders.remove(ref); break;
+			default: return false;
+			}
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	return in.status() == QDataStream::Ok;
+}
+
+bool Journal::replaySaved(ProjectModel* project, QString& reason) {
+	QFile file(fileNameFor(project->fileName));
+	if (!file.exists()) return true;
+	if (!file.open(QIODevice::ReadOnly)) {
+		reason = "Couldn't open " + file.fileName() + ": " + file.errorString();
+		return false;
+	}
+	if (!readHeader(file, project->fileName)) {
+		qWarning() << "Ignored" << file.fileName() << "as it belongs to a different version of the project";
+		return true;
+	}
+
+	const QList<JournalBlock> blocks = readBlocks(file, HeaderSize);
+	qint64 savedEnd = HeaderSize;
+	for (const auto& block : blocks) {
+		if (block.kind == SavedBlock) savedEnd = block.end;
+	}
+	ReplayState state;
+	for (const auto& block : blocks) {
+		if (block.kind != StepBlock || block.end > savedEnd) continue;
+		if (!applyStep(block.payload, project, &state)) {
+			reason = file.fileName() + " is corrupt";
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Journal::fold(const QString& projectFileName, QString& reason) {
+	{
+		// A journal of another version of the file isn't folded into it, nor deleted
+		QFile file(fileNameFor(projectFileName));
+		if (file.open(QIODevice::ReadOnly) && !readHeader(file, projectFileName)) {
+			file.close();
+			keepAside(file.fileName(), ".old");
+			return true;
+		}
+	}
+
+	ProjectModel project;
+	if (!project.load(projectFileName, reason)) return false;
+	if (!replaySaved(&project, reason)) return false;
+	if (!project.save(projectFileName)) {
+		reason = project.exportLog.join("\n");
+		return false;
+	}
+	QFile::remove(fileNameFor(projectFileName));
+	return true;
+}
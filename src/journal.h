@@ -0,0 +1,127 @@
+#ifndef MMPIXEL_JOURNAL_H
+#define MMPIXEL_JOURNAL_H
+
+#include "projectmodel.h"
+
+#include <QFile>
+#include <QHash>
+#include <QRect>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+// An append-only log of the edits to a project since its file was last written,
+// kept next to it in <project>.journal. Each edit is one step holding the state of
+// what it changed, not the command: the pixels in the dirty rect of a frame that
+// was drawn on, or the metadata of an asset that was renamed, moved and so on.
+// Steps are replayed on top of the project file after a crash. A save can append
+// a saved marker instead of writing the project file, which is then only folded
+// into the project file when the journal gets large or the project is closed.
+class Journal {
+public:
+	Journal() = default;
+	~Journal();
+
+	static QString fileNameFor(const QString& projectFileName);
+
+	// Starts a new journal for project, whose file must have just been loaded or written
+	bool start(ProjectModel* project);
+
+	// Continues the journal of project, which must have just been loaded from its file.
+	// The saved steps are replayed, and the number of unsaved steps after them is returned.
+	// Returns false, and start()s a new journal, if the journal doesn't belong to the file or
+	// a step can't be replayed. The old journal is kept next to it then (see keepAside()), and
+	// the project is loaded from its file again so none of the journal is applied.
+	bool resume(ProjectModel* project, int* unsavedSteps, QString& reason);
+	// Returns false, with the project back to its saved steps, if a step can't be replayed
+	bool replayUnsaved(QString& reason);
+	void discardUnsaved();
+
+	// Stops writing. The journal file is kept unless discard is set.
+	void stop(bool discard);
+
+	bool isActive() const { return mProject != nullptr; }
+	bool hasSavedSteps() const { return mSavedEnd > HeaderSize; }
+	qint64 size() const { return mFile.isOpen() ? mFile.size() : 0; }
+
+	// Marks what a command changed, it's written by the next flush()
+	void partChanged(AssetRef ref);
+	void frameChanged(AssetRef part, const QString& mode, int frame, const QRect& rect = QRect()); // the pixels in rect, or all of them
+	void compositeChanged(AssetRef ref);
+	void folderChanged(AssetRef ref);
+	void assetsChanged(); // assets were added, deleted or moved
+
+	// Appends a step with everything that changed since the last flush. Call this
+	// whenever a command has been done, undone or redone.
+	bool flush();
+
+	// Marks everything in the journal so far as saved
+	bool markSaved();
+
+	// Replays only the saved steps of the journal of project, e.g. for tools that
+	// read a project but don't edit it. Does nothing if there is no journal.
+	static bool replaySaved(ProjectModel* project, QString& reason);
+
+	// Writes the saved steps into the project file and deletes the journal
+	static bool fold(const QString& projectFileName, QString& reason);
+
+private:
+	Q_DISABLE_COPY(Journal)
+
+	static const qint64 HeaderSize = 24;
+
+	struct FrameRef {
+		AssetRef part;
+		QString mode;
+		int frame;
+		QRect rect;
+	};
+
+	struct ReplayState {
+		QHash<quint32, Frame> frames;
+		qint64 savedEnd = HeaderSize; // after the last saved marker
+		qint64 end = HeaderSize; // after the last complete step
+		QList<QByteArray> unsaved; // the steps after the last saved marker
+	};
+
+	void reset();
+	static bool readHeader(QFile& file, const QString& projectFileName);
+	static QString keepAside(const QString& fileName, const QString& suffix);
+	bool reloadProject(ProjectModel* project, QString& reason);
+	static bool applyStep(const QByteArray& step, ProjectModel* project, ReplayState* state);
+	void adoptReplayed(const ReplayState& state);
+
+	bool appendBlock(quint8 kind, const QByteArray& payload);
+	quint32 writeFrame(QDataStream& out, const Frame& frame);
+	void writePart(QDataStream& out, const Part& part);
+
+	ProjectModel* mProject = nullptr;
+	QFile mFile;
+	qint64 mSavedEnd = HeaderSize;
+	ReplayState mPending; // the unsaved steps found by resume()
+
+	// Changed since the last flush
+	QSet<AssetRef> mParts;
+	QSet<AssetRef> mComposites;
+	QSet<AssetRef> mFolders;
+	QList<FrameRef> mFrames;
+	bool mAssetsChanged = false;
+
+	QHash<Frame::Data*, QRect> mDirty; // of the frames in mFrames, while they're written
+
+	// What has been journaled. Frames are identified by their shared data, which is
+	// only watched so it's freed with the frame, with the QImage::cacheKey() of the
+	// pixels last written for each (0 if they were written without being decoded).
+	// Once a frame's pixels are journaled, only the rects commands report them drawn
+	// on are written. Ids of frames that have been freed are dropped on each flush.
+	struct FrameId {
+		quint32 id;
+		QWeakPointer<Frame::Data> data;
+	};
+	QHash<AssetRef, AssetRef> mParents;
+	QHash<Frame::Data*, FrameId> mFrameIds;
+	QHash<quint32, qint64> mFrameKeys;
+	quint32 mNextFrameId = 1;
+};
+
+#endif
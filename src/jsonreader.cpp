@@ -0,0 +1,323 @@
+#include "jsonreader.h"
+
+#include <cstring>
+#include <limits>
+
+static bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static int hexValue(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+JsonReader::JsonReader(const QByteArray& data)
+	:mBegin(data.constData()), mEnd(data.constData() + data.size()), mPos(data.constData())
+{
+	const void* nul = memchr(mBegin, '\0', size_t(data.size()));
+	if (nul) mEnd = static_cast<const char*>(nul);
+}
+
+void JsonReader::skipWhitespace() {
+	while (mPos < mEnd && (*mPos == ' ' || *mPos == '\n' || *mPos == '\r' || *mPos == '\t')) {
+		++mPos;
+	}
+}
+
+JsonReader::Token JsonReader::error(const char* message) {
+	mError = QString::fromLatin1(message);
+	mToken = Invalid;
+	return mToken;
+}
+
+JsonReader::Token JsonReader::readNext() {
+	if (mToken == Invalid) return mToken;
+	if (mState == Finished) return mToken = EndDocument;
+
+	skipWhitespace();
+	switch (mState) {
+	case ExpectRoot:
+		if (mPos == mEnd) return error("the document is empty");
+		return readValue();
+
+	case ExpectKeyOrEnd:
+		if (mPos < mEnd && *mPos == '}') {
+			++mPos;
+			mStack.removeLast();
+			mState = AfterValue;
+			return mToken = EndObject;
+		}
+		// fall through
+	case ExpectKey:
+		if (mPos == mEnd) return error("unterminated object");
+		if (*mPos != '"') return error("expected the name of a member");
+		if (readStringToken(Key) == Invalid) return mToken;
+		skipWhitespace();
+		if (mPos == mEnd || *mPos != ':') return error("missing name separator");
+		++mPos;
+		mState = ExpectValue;
+		return mToken;
+
+	case ExpectValueOrEnd:
+		if (mPos < mEnd && *mPos == ']') {
+			++mPos;
+			mStack.removeLast();
+			mState = AfterValue;
+			return mToken = EndArray;
+		}
+		// fall through
+	case ExpectValue:
+		if (mPos == mEnd) return error(mStack.last() == '{' ? "unterminated object" : "unterminated array");
+		return readValue();
+
+	case AfterValue: {
+		if (mStack.isEmpty()) {
+			if (mPos != mEnd) return error("garbage at the end of the document");
+			mState = Finished;
+			return mToken = EndDocument;
+		}
+		const bool inObject = mStack.last() == '{';
+		if (mPos == mEnd) return error(inObject ? "unterminated object" : "unterminated array");
+		if (*mPos == ',') {
+			++mPos;
+			mState = inObject ? ExpectKey : ExpectValue;
+			return readNext();
+		}
+		if (*mPos == (inObject ? '}' : ']')) {
+			++mPos;
+			mStack.removeLast();
+			return mToken = inObject ? EndObject : EndArray;
+		}
+		return error("missing value separator");
+	}
+
+	case Finished:
+		break;
+	}
+	return mToken;
+}
+
+JsonReader::Token JsonReader::readValue() {
+	switch (*mPos) {
+	case '{':
+		++mPos;
+		mStack.append('{');
+		mState = ExpectKeyOrEnd;
+		return mToken = StartObject;
+	case '[':
+		++mPos;
+		mStack.append('[');
+		mState = ExpectValueOrEnd;
+		return mToken = StartArray;
+	case '"':
+		if (readStringToken(String) == Invalid) return mToken;
+		mState = AfterValue;
+		return mToken;
+	case 't':
+		return readLiteral("true", Bool);
+	case 'f':
+		return readLiteral("false", Bool);
+	case 'n':
+		return readLiteral("null", Null);
+	default:
+		if (*mPos == '-' || isDigit(*mPos)) return readNumber();
+		return error("illegal value");
+	}
+}
+
+JsonReader::Token JsonReader::readStringToken(Token token) {
+	++mPos; // "
+	const char* start = mPos;
+	mEscaped = false;
+	while (mPos < mEnd) {
+		const uchar c = uchar(*mPos);
+		if (c == '"') {
+			mValue = start;
+			mValueLength = int(mPos - start);
+			++mPos;
+			return mToken = token;
+		}
+		else if (c == '\\') {
+			mEscaped = true;
+			if (++mPos == mEnd) break;
+			switch (*mPos) {
+			case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+				++mPos;
+				break;
+			case 'u':
+				++mPos;
+				for (int i = 0; i < 4; i++, ++mPos) {
+					if (mPos == mEnd || hexValue(*mPos) < 0) return error("invalid escape sequence");
+				}
+				break;
+			default:
+				return error("invalid escape sequence");
+			}
+		}
+		else if (c < 0x20) {
+			return error("unescaped control character in string");
+		}
+		else {
+			++mPos;
+		}
+	}
+	return error("unterminated string");
+}
+
+JsonReader::Token JsonReader::readNumber() {
+	const char* start = mPos;
+	if (*mPos == '-') ++mPos;
+	if (mPos == mEnd || !isDigit(*mPos)) return error("illegal number");
+	if (*mPos == '0') {
+		++mPos;
+	}
+	else {
+		while (mPos < mEnd && isDigit(*mPos)) ++mPos;
+	}
+	if (mPos < mEnd && *mPos == '.') {
+		++mPos;
+		if (mPos == mEnd || !isDigit(*mPos)) return error("illegal number");
+		while (mPos < mEnd && isDigit(*mPos)) ++mPos;
+	}
+	if (mPos < mEnd && (*mPos == 'e' || *mPos == 'E')) {
+		++mPos;
+		if (mPos < mEnd && (*mPos == '+' || *mPos == '-')) ++mPos;
+		if (mPos == mEnd || !isDigit(*mPos)) return error("illegal number");
+		while (mPos < mEnd && isDigit(*mPos)) ++mPos;
+	}
+	mValue = start;
+	mValueLength = int(mPos - start);
+	mState = AfterValue;
+	return mToken = Number;
+}
+
+JsonReader::Token JsonReader::readLiteral(const char* literal, Token token) {
+	const size_t length = strlen(literal);
+	if (size_t(mEnd - mPos) < length || memcmp(mPos, literal, length) != 0) return error("illegal value");
+	mPos += length;
+	mBool = (literal[0] == 't');
+	mState = AfterValue;
+	return mToken = token;
+}
+
+QString JsonReader::toString() const {
+	if (mToken != String && mToken != Key) return QString();
+	if (!mEscaped) return QString::fromUtf8(mValue, mValueLength);
+
+	QString result;
+	result.reserve(mValueLength);
+	const char* p = mValue;
+	const char* const end = mValue + mValueLength;
+	const char* run = p; // unescaped characters since the last escape sequence
+	while (p < end) {
+		if (*p != '\\') {
+			++p;
+			continue;
+		}
+		result.append(QString::fromUtf8(run, int(p - run)));
+		++p;
+		switch (*p++) {
+		case 'b': result.append(QChar('\b')); break;
+		case 'f': result.append(QChar('\f')); break;
+		case 'n': result.append(QChar('\n')); break;
+		case 'r': result.append(QChar('\r')); break;
+		case 't': result.append(QChar('\t')); break;
+		case 'u': {
+			// Surrogate pairs are two escape sequences, which end up as the two halves in the QString
+			ushort code = 0;
+			for (int i = 0; i < 4; i++) code = ushort((code << 4) | hexValue(*p++));
+			result.append(QChar(code));
+			break;
+		}
+		default: result.append(QChar(p[-1])); break; // " \ /
+		}
+		run = p;
+	}
+	result.append(QString::fromUtf8(run, int(p - run)));
+	return result;
+}
+
+double JsonReader::toDouble() const {
+	if (mToken != Number) return 0;
+
+	// Almost every number in a project is a small integer
+	const char* p = mValue;
+	const bool negative = (*p == '-');
+	if (negative) ++p;
+	const int digits = int(mValue + mValueLength - p);
+	if (digits <= 9) {
+		int value = 0;
+		for (int i = 0; i < digits; i++) {
+			if (!isDigit(p[i])) return QByteArray(mValue, mValueLength).toDouble();
+			value = value * 10 + (p[i] - '0');
+		}
+		return negative ? -value : value;
+	}
+	return QByteArray(mValue, mValueLength).toDouble();
+}
+
+int JsonReader::toInt() const {
+	const double value = toDouble();
+	if (value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max()) return 0;
+	const int i = int(value);
+	return (double(i) == value) ? i : 0;
+}
+
+bool JsonReader::toBool() const {
+	return mToken == Bool && mBool;
+}
+
+bool JsonReader::keyIs(const char* key) const {
+	if (mToken != Key) return false;
+	if (mEscaped) return toString() == QLatin1String(key);
+	return strlen(key) == size_t(mValueLength) && memcmp(key, mValue, size_t(mValueLength)) == 0;
+}
+
+void JsonReader::skipCurrent() {
+	if (mToken != StartObject && mToken != StartArray) return;
+	const int depth = mStack.size();
+	while (readNext() != Invalid && mStack.size() >= depth) {}
+}
+
+bool JsonReader::readStartObject() {
+	if (readNext() == StartObject) return true;
+	skipCurrent();
+	return false;
+}
+
+bool JsonReader::readStartArray() {
+	if (readNext() == StartArray) return true;
+	skipCurrent();
+	return false;
+}
+
+bool JsonReader::readMember() {
+	return readNext() == Key;
+}
+
+bool JsonReader::readElement() {
+	const Token token = readNext();
+	return token != EndArray && token != Invalid && token != EndDocument;
+}
+
+QString JsonReader::readString() {
+	readNext();
+	const QString value = toString();
+	skipCurrent();
+	return value;
+}
+
+int JsonReader::readInt() {
+	readNext();
+	const int value = toInt();
+	skipCurrent();
+	return value;
+}
+
+void JsonReader::skipValue() {
+	readNext();
+	skipCurrent();
+}
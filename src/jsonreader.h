@@ -0,0 +1,91 @@
+#ifndef MMPIXEL_JSONREADER_H
+#define MMPIXEL_JSONREADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVarLengthArray>
+
+// Reads a JSON document one token at a time, like QXmlStreamReader, so a caller can
+// build its own structures without a QJsonDocument of the whole document in memory.
+// The data isn't copied and must outlive the reader. Reading stops at the first
+// NUL character, which old project files are padded with.
+class JsonReader {
+public:
+	enum Token {
+		NoToken,
+		StartObject,
+		EndObject,
+		StartArray,
+		EndArray,
+		Key, // the name of an object member, the value is the next token
+		String,
+		Number,
+		Bool,
+		Null,
+		EndDocument,
+		Invalid, // see errorString() and offset()
+	};
+
+	explicit JsonReader(const QByteArray& data);
+
+	Token readNext();
+	Token token() const { return mToken; }
+	bool hasError() const { return mToken == Invalid; }
+	QString errorString() const { return mError; }
+	int offset() const { return int(mPos - mBegin); } // of the current position, or the error
+
+	// The value of the current token, converted like QJsonValue does: a key or string
+	// is an empty string if the token is something else, a number is 0 and so on.
+	QString toString() const;
+	int toInt() const; // 0 unless the token is a number without a fraction
+	double toDouble() const;
+	bool toBool() const;
+	bool keyIs(const char* key) const; // compares the key without converting it to a QString
+
+	// Reads past the end of the object or array that starts at the current token
+	void skipCurrent();
+
+	// Helpers for reading a known structure. Each reads the next value and skips it
+	// if it's not of the expected type.
+	bool readStartObject();
+	bool readStartArray();
+	bool readMember(); // the next key of the current object, false at the end of it
+	bool readElement(); // the next element of the current array, false at the end of it
+	QString readString();
+	int readInt();
+	void skipValue();
+
+private:
+	void skipWhitespace();
+	Token error(const char* message);
+	Token readValue();
+	Token readStringToken(Token token);
+	Token readNumber();
+	Token readLiteral(const char* literal, Token token);
+
+	enum State {
+		ExpectRoot,
+		ExpectKeyOrEnd,
+		ExpectKey,
+		ExpectValue,
+		ExpectValueOrEnd,
+		AfterValue,
+		Finished,
+	};
+
+	const char* mBegin = nullptr;
+	const char* mEnd = nullptr;
+	const char* mPos = nullptr;
+	QVarLengthArray<char, 16> mStack; // '{' or '[' for each open container
+	State mState = ExpectRoot;
+	Token mToken = NoToken;
+	QString mError;
+
+	// The current key, string or number, in the data
+	const char* mValue = nullptr;
+	int mValueLength = 0;
+	bool mEscaped = false; // the string contains escape sequences
+	bool mBool = false;
+};
+
+#endif
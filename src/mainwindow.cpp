@@ -8,6 +8,10 @@
 #include "animationwidget.h"
 #include "propertieswidget.h"
 #include "optionswidget.h"
+#include "autosave.h"
+#include "journal.h"
+#include "undobudget.h"
+#include "changebus.h"
 
 #include <QSortFilterProxyModel>
 #include <QDebug>
@@ -37,6 +41,7 @@ MainWindow::MainWindow(QWidget *parent) :
 {
     sWindow = this;
     mProjectModel = new ProjectModel();	
+	mJournal = new Journal();
     // mProjectModel->loadTestData();
 
     ui->setupUi(this);
@@ -89,6 +94,13 @@ MainWindow::MainWindow(QWidget *parent) :
 	
     mUndoStack = new QUndoStack(this);
 	connect(mUndoStack, SIGNAL(indexChanged(int)), this, SLOT(undoStackIndexChanged(int)));
+	mChanges = new ChangeBus(this);
+	connect(mChanges, &ChangeBus::flushed, this, &MainWindow::applyChanges);
+	mUndoBudget = new UndoBudget(mUndoStack, this);
+	mUndoUsageLabel = new QLabel(this);
+	statusBar()->addPermanentWidget(mUndoUsageLabel);
+	connect(mUndoBudget, &UndoBudget::usageChanged, this, &MainWindow::undoUsageChanged);
+	undoUsageChanged(0, mUndoBudget->budget());
 
 	{
 		auto* dock = new QDockWidget("Composite Tools", this);
@@ -169,10 +181,21 @@ MainWindow::MainWindow(QWidget *parent) :
 		restoreGeometry(settings.value("main_window_geometry").toByteArray());
 		restoreState(settings.value("main_window_state").toByteArray());
 	}
+
+	mAutosave = new Autosave(this);
+	connect(mAutosave, &Autosave::finished, this, &MainWindow::autosaveFinished);
+	mAutosaveTimer = new QTimer(this);
+	connect(mAutosaveTimer, &QTimer::timeout, this, &MainWindow::autosaveProject);
+	setAutosaveInterval(GlobalPreferences().autosaveMinutes);
+
+	// Once the window is shown
+	QTimer::singleShot(0, this, &MainWindow::recoverAutosavedProject);
 }
 
 MainWindow::~MainWindow()
 {
+	mAutosave->wait();
+	delete mJournal;
     delete ui;
     delete mUndoStack;
     // delete ProjectModel last
@@ -232,6 +255,50 @@ void MainWindow::showViewOptionsDialog(){
         auto* spinBox = optionsWidget->findChild<QSpinBox*>("spinBoxMaxZoom");
         spinBox->setValue(prefs.maxZoom * 100);
         connect(spinBox, SIGNAL(valueChanged(int)), this, SLOT(changeMaxZoom(int)));
+
+		checkBox = optionsWidget->findChild<QCheckBox*>("checkBoxLazyLoadFrames");
+		checkBox->setChecked(prefs.lazyLoadFrames);
+		connect(checkBox, &QCheckBox::toggled, [this](bool checked) {
+			GlobalPreferences().lazyLoadFrames = checked;
+			savePreferences();
+		});
+
+		checkBox = optionsWidget->findChild<QCheckBox*>("checkBoxBinaryProjectData");
+		checkBox->setChecked(prefs.binaryProjectData);
+		connect(checkBox, &QCheckBox::toggled, [this](bool checked) {
+			GlobalPreferences().binaryProjectData = checked;
+			savePreferences();
+		});
+
+		spinBox = optionsWidget->findChild<QSpinBox*>("spinBoxAutosave");
+		spinBox->setValue(prefs.autosaveMinutes);
+		connect(spinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this](int value) {
+			GlobalPreferences().autosaveMinutes = value;
+			setAutosaveInterval(value);
+			savePreferences();
+		});
+
+		spinBox = optionsWidget->findChild<QSpinBox*>("spinBoxCompressionLevel");
+		spinBox->setValue(prefs.compressionLevel);
+		connect(spinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this](int value) {
+			GlobalPreferences().compressionLevel = value;
+			savePreferences();
+		});
+
+		spinBox = optionsWidget->findChild<QSpinBox*>("spinBoxUndoMemory");
+		spinBox->setValue(prefs.undoMemoryMB);
+		connect(spinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this](int value) {
+			GlobalPreferences().undoMemoryMB = value;
+			mUndoBudget->setBudget((qint64) value << 20);
+			savePreferences();
+		});
+
+		checkBox = optionsWidget->findChild<QCheckBox*>("checkBoxQuickSave");
+		checkBox->setChecked(prefs.quickSave);
+		connect(checkBox, &QCheckBox::toggled, [this](bool checked) {
+			GlobalPreferences().quickSave = checked;
+			savePreferences();
+		});
     }
 
 	{
@@ -344,6 +411,9 @@ void MainWindow::createMenus(){
 	QAction* exportProjectActionAs = mFileMenu->addAction("Export As...");	
 	connect(exportProjectActionAs, SIGNAL(triggered()), this, SLOT(exportProjectAs()));
 
+	QAction* exportAtlasAction = mFileMenu->addAction("Export Atlas...");
+	connect(exportAtlasAction, SIGNAL(triggered()), this, SLOT(exportProjectAtlas()));
+
 	mFileMenu->addSeparator();
 
     QAction* quitAction = mFileMenu->addAction("&Quit");
@@ -446,6 +516,9 @@ void MainWindow::closeEvent(QCloseEvent*){
     QSettings settings;
     settings.setValue("main_window_geometry", saveGeometry());
     settings.setValue("main_window_state", saveState());
+
+	// The recovery file and the unsaved steps of the journal are only kept if the app didn't close properly
+	closeProject();
 }
 
 void MainWindow::loadPreferences() {
@@ -467,6 +540,13 @@ void MainWindow::loadPreferences() {
 
 	prefs.showOnionSkinning = settings.value("prefs.showOnionSkinning", prefs.showOnionSkinning).toBool();
 	prefs.onionSkinningOpacity = settings.value("prefs.onionSkinningOpacity", prefs.onionSkinningOpacity).toFloat();
+
+	prefs.lazyLoadFrames = settings.value("prefs.lazyLoadFrames", prefs.lazyLoadFrames).toBool();
+	prefs.binaryProjectData = settings.value("prefs.binaryProjectData", prefs.binaryProjectData).toBool();
+	prefs.compressionLevel = qBound(0, settings.value("prefs.compressionLevel", prefs.compressionLevel).toInt(), 10);
+	prefs.autosaveMinutes = qMax(0, settings.value("prefs.autosaveMinutes", prefs.autosaveMinutes).toInt());
+	prefs.quickSave = settings.value("prefs.quickSave", prefs.quickSave).toBool();
+	prefs.undoMemoryMB = qMax(1, settings.value("prefs.undoMemoryMB", prefs.undoMemoryMB).toInt());
 }
 
 void MainWindow::savePreferences() {
@@ -488,6 +568,13 @@ void MainWindow::savePreferences() {
 
 	settings.setValue("prefs.showOnionSkinning", prefs.showOnionSkinning);
 	settings.setValue("prefs.onionSkinningOpacity", prefs.onionSkinningOpacity);
+
+	settings.setValue("prefs.lazyLoadFrames", prefs.lazyLoadFrames);
+	settings.setValue("prefs.binaryProjectData", prefs.binaryProjectData);
+	settings.setValue("prefs.compressionLevel", prefs.compressionLevel);
+	settings.setValue("prefs.autosaveMinutes", prefs.autosaveMinutes);
+	settings.setValue("prefs.quickSave", prefs.quickSave);
+	settings.setValue("prefs.undoMemoryMB", prefs.undoMemoryMB);
 }
 
 void MainWindow::updatePreferences() {
@@ -506,6 +593,50 @@ void MainWindow::updatePreferences() {
 	savePreferences();
 }
 
+void MainWindow::setAutosaveInterval(int minutes) {
+	if (minutes > 0) {
+		mAutosaveTimer->start(minutes * 60 * 1000);
+	}
+	else {
+		mAutosaveTimer->stop();
+	}
+}
+
+// Closes the windows of the project and clears it. Edits that were quick saved are
+// then written into the project file, once nothing has it open anymore.
+void MainWindow::closeProject() {
+	mAutosave->wait();
+
+	mCompositeToolsWidget->setTargetCompWidget(nullptr);
+	mDrawingTools->setTargetPartWidget(nullptr);
+	mAnimationWidget->setTargetPartWidget(nullptr);
+	mPropertiesWidget->setTargetPartWidget(nullptr);
+	mMdiArea->closeAllSubWindows();
+
+	const QString fileName = PM()->fileName;
+	const bool fold = mJournal->hasSavedSteps();
+	mJournal->stop(false);
+
+	mUndoStack->clear();
+	ProjectModel::Instance()->clear();
+	mChanges->discard(); // they're about assets that are gone
+	mPartList->resetIcons();
+	mPartList->updateList();
+
+	// Its recovery file goes with it, the next project gets its own
+	mAutosave->discardRecoveryFile();
+	mAutosave->setProject(QString());
+
+	if (fold) {
+		QString reason;
+		if (!Journal::fold(fileName, reason)) {
+			qWarning() << "Couldn't write the journal into" << fileName << reason;
+			QMessageBox::warning(this, "Error during save", tr("Couldn't write the quick saved changes into ") + fileName + tr("\nReason: ") + reason +
+				tr("\nThey're kept in ") + Journal::fileNameFor(fileName));
+		}
+	}
+}
+
 void MainWindow::assetDoubleClicked(AssetRef ref){
 	assetSelected(ref);
 
@@ -653,7 +784,8 @@ CompositeWidget* MainWindow::activeCompositeWidget(){
 }
 
 void MainWindow::partListChanged(){
-    mPartList->updateList();
+	mJournal->assetsChanged();
+	mChanges->assetsChanged();
 
     // Delete any part widgets that don't exist anymore
     QMutableMapIterator<AssetRef,PartWidget*> i(mPartWidgets);
@@ -675,7 +807,9 @@ void MainWindow::partListChanged(){
 }
 
 void MainWindow::newAssetCreated(AssetRef ref) {
-	mPartList->updateList();
+	mJournal->assetsChanged();
+	mChanges->assetsChanged();
+	mChanges->flush(); // so it's in the list to be selected
 
 	if (ref.type == AssetType::Part) {
 		openPartWidget(ref);
@@ -691,7 +825,8 @@ void MainWindow::newAssetCreated(AssetRef ref) {
 }
 
 void MainWindow::partRenamed(AssetRef ref, const QString& newName){
-    mPartList->updateList();
+	mJournal->partChanged(ref);
+	mChanges->assetsChanged();
     for(PartWidget* p: mPartWidgets.values(ref)){
         p->partNameChanged(newName);
     }
@@ -713,106 +848,39 @@ void MainWindow::partRenamed(AssetRef ref, const QString& newName){
     }
 }
 
-void MainWindow::partFrameUpdated(AssetRef ref, const QString& mode, int frame){
-    if (mPartWidgets.contains(ref)){
-        for(PartWidget* p: mPartWidgets.values(ref)){
-            p->partFrameUpdated(ref, mode, frame);
-        }
-    }
-
-    for(CompositeWidget* cw: mCompositeWidgets.values()){
-        cw->partFrameUpdated(ref, mode, frame);
-    }
-
-	mPartList->updateIcon(ref);
+void MainWindow::partFrameUpdated(AssetRef ref, const QString& mode, int frame, const QRect& rect){
+	mJournal->frameChanged(ref, mode, frame, rect);
+	mChanges->frameChanged(ref, mode, frame, rect);
 }
 
 void MainWindow::partFramesUpdated(AssetRef ref, const QString& mode){
-    for(PartWidget* p: mPartWidgets.values(ref)){
-        p->partFramesUpdated(ref, mode);
-    }
-
-	if (mAnimationWidget->isEnabled() && mAnimationWidget->targetPartWidget()) {
-		if (mAnimationWidget->targetPartWidget()->partRef() == ref &&
-			mAnimationWidget->targetPartWidget()->modeName() == mode) {
-			mAnimationWidget->targetPartNumFramesChanged();
-		}
-	}
-
-    for(CompositeWidget* cw: mCompositeWidgets.values()){
-        cw->partFramesUpdated(ref, mode);
-    }
-
-	mPartList->updateIcon(ref);
+	mJournal->partChanged(ref);
+	mChanges->framesChanged(ref, mode);
 }
 
 void MainWindow::partNumPivotsUpdated(AssetRef ref, const QString& mode){
-    for(PartWidget* p: mPartWidgets.values(ref)){
-        p->partNumPivotsUpdated(ref, mode);
-    }
-
-	if (mAnimationWidget->targetPartWidget()) {
-		if (mAnimationWidget->targetPartWidget()->partRef() == ref && mAnimationWidget->targetPartWidget()->modeName() == mode) {
-			mAnimationWidget->targetPartNumPivotsChanged();
-		}
-	}
-
-    for(CompositeWidget* cw: mCompositeWidgets.values()){
-        cw->partNumPivotsUpdated(ref, mode);
-    }
+	mJournal->partChanged(ref);
+	mChanges->pivotsChanged(ref, mode);
 }
 
 void MainWindow::partPropertiesUpdated(AssetRef ref){
-    for(PartWidget* p: mPartWidgets.values(ref)){
-        p->partPropertiesChanged(ref);
-    }
-
-	if (mPropertiesWidget->targetPartWidget()) {
-		if (mPropertiesWidget->targetPartWidget()->partRef() == ref) {
-			mPropertiesWidget->targetPartPropertiesChanged();
-		}
-	}
+	mJournal->partChanged(ref);
+	mChanges->partPropertiesChanged(ref);
 }
 
 void MainWindow::compPropertiesUpdated(AssetRef comp){
-    for(CompositeWidget* cw: mCompositeWidgets.values(comp)){
-        cw->updateCompFrames();
-    }
-    if (mCompositeToolsWidget->isEnabled()){
-       if (mCompositeToolsWidget->compRef()==comp){
-           mCompositeToolsWidget->targetCompPropertiesChanged();
-        }
-    }
+	mJournal->compositeChanged(comp);
+	mChanges->compPropertiesChanged(comp);
 }
 
 void MainWindow::partModesChanged(AssetRef ref){
-    const Part* part = PM()->getPart(ref);
-    for(PartWidget* p: mPartWidgets.values(ref)){
-        if (!part->modes.contains(p->modeName())){
-            // Reset mode
-            p->setMode(part->modes.keys().front());
-        }
-        else {
-			p->setMode(p->modeName());
-        }
-    }
-
-	if (mAnimationWidget->targetPartWidget()) {
-		if (mAnimationWidget->targetPartWidget()->partRef() == ref) {
-			mAnimationWidget->targetPartModesChanged();
-		}
-	}
-
-    // TODO: Tell composite widgets
-    // for(CompositeWidget* cw: mCompositeWidgets.values()){
-        // cw->partModesChanged(part);
-    // }
-    //if (mCompositeToolsWidget->isEnabled()){
-    //    mCompositeToolsWidget->partModesChanged(ref);
-    //}
+	mJournal->partChanged(ref);
+	mChanges->modesChanged(ref);
 }
 
 void MainWindow::partModeRenamed(AssetRef ref, const QString& oldModeName, const QString& newModeName){
+	mJournal->partChanged(ref);
+
     for(PartWidget* p: mPartWidgets.values(ref)){
         if (p->modeName()==oldModeName){
            p->setMode(newModeName);
@@ -829,7 +897,8 @@ void MainWindow::partModeRenamed(AssetRef ref, const QString& oldModeName, const
 }
 
 void MainWindow::compositeRenamed(AssetRef ref, const QString& newName){
-    mPartList->updateList();
+	mJournal->compositeChanged(ref);
+	mChanges->assetsChanged();
     for(CompositeWidget* cw: mCompositeWidgets.values(ref)){
         cw->compNameChanged(ref);
     }
@@ -840,30 +909,136 @@ void MainWindow::compositeRenamed(AssetRef ref, const QString& newName){
 }
 
 void MainWindow::compositeUpdated(AssetRef ref){
-    for(CompositeWidget* cw: mCompositeWidgets.values(ref)){
-        cw->updateCompFrames();
-    }
-
-    if (mCompositeToolsWidget->isEnabled()){
-         mCompositeToolsWidget->compositeUpdated(ref);
-    }
+	mJournal->compositeChanged(ref);
+	mChanges->compositeChanged(ref, false);
 }
 
 void MainWindow::compositeUpdatedMinorChanges(AssetRef ref){
-    for(CompositeWidget* cw: mCompositeWidgets.values(ref)){
-        cw->updateCompFramesMinorChanges();
-    }
-
-    if (mCompositeToolsWidget->isEnabled()){
-         mCompositeToolsWidget->compositeUpdated(ref);
-    }
+	mJournal->compositeChanged(ref);
+	mChanges->compositeChanged(ref, true);
 }
 
-void MainWindow::folderRenamed(AssetRef ref, const QString& newName){
-    mPartList->updateList();
+void MainWindow::folderRenamed(AssetRef ref, const QString& /*newName*/){
+	mJournal->folderChanged(ref);
+	mChanges->assetsChanged();
     qDebug() << "TODO: Update the visual names/refs of parts and comps that are in this folder";
 }
 
+// Updates the views once for everything the commands since the last turn of the event loop changed
+void MainWindow::applyChanges(const ChangeBus::Changes& changes){
+	if (changes.assets){
+		mPartList->updateList();
+	}
+
+	// Rebuilding the widgets of a part for its modes covers its frames and pivots too
+	for (const AssetRef& ref: changes.modes){
+		const Part* part = PM()->getPart(ref);
+		if (!part) continue;
+		for (PartWidget* p: mPartWidgets.values(ref)){
+			if (!part->modes.contains(p->modeName())){
+				// Reset mode
+				p->setMode(part->modes.keys().front());
+			}
+			else {
+				p->setMode(p->modeName());
+			}
+		}
+
+		if (mAnimationWidget->targetPartWidget()) {
+			if (mAnimationWidget->targetPartWidget()->partRef() == ref) {
+				mAnimationWidget->targetPartModesChanged();
+			}
+		}
+
+		// TODO: Tell composite widgets
+		//if (mCompositeToolsWidget->isEnabled()){
+		//    mCompositeToolsWidget->partModesChanged(ref);
+		//}
+	}
+
+	QSet<AssetRef> parts; // that composites may show
+	for (const auto& key: changes.modeFrames){
+		parts.insert(key.part);
+		if (!PM()->hasPart(key.part) || changes.modes.contains(key.part)) continue;
+		for (PartWidget* p: mPartWidgets.values(key.part)){
+			p->partFramesUpdated(key.part, key.mode);
+		}
+
+		if (mAnimationWidget->isEnabled() && mAnimationWidget->targetPartWidget()) {
+			if (mAnimationWidget->targetPartWidget()->partRef() == key.part &&
+				mAnimationWidget->targetPartWidget()->modeName() == key.mode) {
+				mAnimationWidget->targetPartNumFramesChanged();
+			}
+		}
+	}
+
+	// Each frame that was drawn on is updated on its own
+	for (auto it = changes.frames.constBegin(); it != changes.frames.constEnd(); ++it){
+		const auto& key = it.key();
+		parts.insert(key.part);
+		if (!PM()->hasPart(key.part) || changes.modes.contains(key.part)) continue;
+		for (PartWidget* p: mPartWidgets.values(key.part)){
+			p->partFrameUpdated(key.part, key.mode, key.frame, it.value());
+		}
+	}
+
+	for (const auto& key: changes.pivots){
+		parts.insert(key.part);
+		if (!PM()->hasPart(key.part)) continue;
+		for (PartWidget* p: mPartWidgets.values(key.part)){
+			p->partNumPivotsUpdated(key.part, key.mode);
+		}
+
+		if (mAnimationWidget->targetPartWidget()) {
+			if (mAnimationWidget->targetPartWidget()->partRef() == key.part && mAnimationWidget->targetPartWidget()->modeName() == key.mode) {
+				mAnimationWidget->targetPartNumPivotsChanged();
+			}
+		}
+	}
+
+	for (const AssetRef& ref: changes.partProperties){
+		for (PartWidget* p: mPartWidgets.values(ref)){
+			p->partPropertiesChanged(ref);
+		}
+
+		if (mPropertiesWidget->targetPartWidget()) {
+			if (mPropertiesWidget->targetPartWidget()->partRef() == ref) {
+				mPropertiesWidget->targetPartPropertiesChanged();
+			}
+		}
+	}
+
+	// Each composite widget is updated once, for itself or for the parts it shows
+	for (CompositeWidget* cw: mCompositeWidgets.values()){
+		const AssetRef comp = cw->compRef();
+		if (changes.composites.contains(comp) || changes.compProperties.contains(comp)){
+			cw->updateCompFrames();
+		}
+		else if (changes.compositesMinor.contains(comp)){
+			cw->updateCompFramesMinorChanges();
+		}
+		else if (!parts.isEmpty()){
+			cw->partsUpdated(parts);
+		}
+	}
+
+	if (mCompositeToolsWidget->isEnabled()){
+		for (const AssetRef& ref: changes.composites + changes.compositesMinor){
+			mCompositeToolsWidget->compositeUpdated(ref);
+		}
+		if (changes.compProperties.contains(mCompositeToolsWidget->compRef())){
+			mCompositeToolsWidget->targetCompPropertiesChanged();
+		}
+	}
+
+	QSet<AssetRef> icons;
+	for (const auto& key: changes.modeFrames) icons.insert(key.part);
+	for (const auto& key: changes.frames.keys()) icons.insert(key.part);
+	for (const AssetRef& ref: icons){
+		mPartList->updateIcon(ref);
+	}
+}
+
 void MainWindow::changeBackgroundColour(){
     QColor col = QColorDialog::getColor(GlobalPreferences().backgroundColour, this, tr("Select Background Colour"));
     if (col.isValid()){
@@ -953,39 +1128,16 @@ void MainWindow::resetSettings(){
 void MainWindow::newProject(){
     QMessageBox::StandardButton button = QMessageBox::question(this, "Close Project?", "Really close the current project? All unsaved changes will be lost.");
     if (button==QMessageBox::Yes){
-        // Close all windows and deactivate
-        mCompositeToolsWidget->setTargetCompWidget(nullptr);
-		mDrawingTools->setTargetPartWidget(nullptr);
-		mAnimationWidget->setTargetPartWidget(nullptr);
-		mPropertiesWidget->setTargetPartWidget(nullptr);
-        mMdiArea->closeAllSubWindows();
-
-        // Clear undo stack
-        mUndoStack->clear();
-
-        // Clear current project model
-        ProjectModel::Instance()->clear();
-		mPartList->resetIcons();
-        mPartList->updateList();
+		closeProject();
 
+		mProjectModifiedSinceAutosave = false;
         setWindowTitle(makeWindowTitle());
         qInfo() << "New Project";
     }
 }
 
 void MainWindow::loadProject(const QString& fileName){
-    mCompositeToolsWidget->setTargetCompWidget(nullptr);
-	mDrawingTools->setTargetPartWidget(nullptr);
-	mAnimationWidget->setTargetPartWidget(nullptr);
-	mPropertiesWidget->setTargetPartWidget(nullptr);
-
-	// NB: This is done in a signal
-    // mMdiArea->closeAllSubWindows();
-
-    mUndoStack->clear();
-    ProjectModel::Instance()->clear();
-	mPartList->resetIcons();
-    mPartList->updateList();
+	closeProject();
 	
 	/*
 	QMessageBox* loadingMessage = new QMessageBox(this);
@@ -1014,6 +1166,28 @@ void MainWindow::loadProject(const QString& fileName){
         mPartList->updateList();
     }
     else {
+		// Replay the edits quick saved to the journal, and offer the ones that weren't saved
+		int unsavedSteps = 0;
+		bool restored = false;
+		if (!mJournal->resume(mProjectModel, &unsavedSteps, reason)) {
+			qWarning() << reason;
+			QMessageBox::warning(this, "Quick saved changes not restored", reason);
+		}
+		else if (unsavedSteps > 0) {
+			QMessageBox::StandardButton button = QMessageBox::question(this, "Restore Changes?",
+				QString("%1 has %2 unsaved edits from when MQ Sprite didn't close properly. Restore them?").arg(QFileInfo(fileName).fileName()).arg(unsavedSteps));
+			if (button == QMessageBox::Yes) {
+				restored = mJournal->replayUnsaved(reason);
+				if (!restored) {
+					qWarning() << reason;
+					QMessageBox::warning(this, "Unsaved changes not restored", reason);
+				}
+			}
+			else {
+				mJournal->discardUnsaved();
+			}
+		}
+
 		mPartList->resetIcons();
         mPartList->updateList();
 
@@ -1029,8 +1203,11 @@ void MainWindow::loadProject(const QString& fileName){
             mViewOptionsDockWidget = nullptr;
         }
 
-        mProjectModifiedSinceLastSave = false;
-        setWindowTitle(makeWindowTitle(fileName, true));
+        mProjectModifiedSinceLastSave = restored;
+		mProjectModifiedSinceAutosave = restored;
+		mAutosave->setProject(fileName);
+		mAutosave->discardRecoveryFile();
+        setWindowTitle(makeWindowTitle(fileName, !restored));
         qInfo() << "Loaded " << fileName;
 
 		if (PM()->composites.size() > 0 && !mViewMenu->actions().contains(mCompositeToolsWindowAction)) {
@@ -1074,6 +1251,9 @@ void MainWindow::saveProject(){
         saveProjectAs();
     }
     else {
+		mAutosave->wait();
+		if (quickSaveProject()) return;
+
         bool result = ProjectModel::Instance()->save(fileName);
         if (!result){
 			qWarning() << "Error during save";
@@ -1081,9 +1261,12 @@ void MainWindow::saveProject(){
             QMessageBox::warning(this, "Error during save", tr("Couldn't save ") + fileName + "!\n" + mProjectModel->exportLog.mid(0, 10).join("\n"));
         }
         else {
+			mJournal->start(mProjectModel);
             mProjectModifiedSinceLastSave = false;
+			mProjectModifiedSinceAutosave = false;
+			mAutosave->discardRecoveryFile();
 			setWindowTitle(makeWindowTitle(fileName, true));
-            MainWindow::Instance()->showMessage("Successfully saved");
+            MainWindow::Instance()->showMessage(QString("Successfully saved (%1 KB in %2ms)").arg(mProjectModel->lastSave.bytesWritten / 1024).arg(mProjectModel->lastSave.elapsedMs));
 
 			if (!mProjectModel->exportLog.isEmpty()) {
 				qWarning() << "Error during save";
@@ -1106,6 +1289,7 @@ void MainWindow::saveProjectAs(){
         fileName = saveDialog.selectedFiles().first();
     }
     if (!fileName.isNull()){
+		mAutosave->wait();
         bool result = ProjectModel::Instance()->save(fileName);
         if (!result){
 			qWarning() << "Error during save";
@@ -1117,9 +1301,15 @@ void MainWindow::saveProjectAs(){
             QDir lastOpenedPath = QFileInfo(fileName).absoluteDir();
             settings.setValue("last_save_dir", lastOpenedPath.absolutePath());
 
+			// The journal of the previous file only keeps what was saved into it
+			mJournal->stop(false);
+			mJournal->start(mProjectModel);
             mProjectModifiedSinceLastSave = false;
+			mProjectModifiedSinceAutosave = false;
+			mAutosave->discardRecoveryFile();
+			mAutosave->setProject(fileName);
 			setWindowTitle(makeWindowTitle(fileName, true));
-            MainWindow::Instance()->showMessage("Successfully saved");
+            MainWindow::Instance()->showMessage(QString("Successfully saved (%1 KB in %2ms)").arg(mProjectModel->lastSave.bytesWritten / 1024).arg(mProjectModel->lastSave.elapsedMs));
 
 			if (!mProjectModel->exportLog.isEmpty()) {
 				qWarning() << "Error during save";
@@ -1130,6 +1320,26 @@ void MainWindow::saveProjectAs(){
     }
 }
 
+// Appends a saved marker to the journal instead of writing the project file, while
+// the journal is small compared to the project. Returns false if it wasn't done.
+bool MainWindow::quickSaveProject() {
+	static const qint64 MaxJournalSize = 64 * 1024 * 1024;
+	const QString fileName = mProjectModel->fileName;
+	if (!GlobalPreferences().quickSave || !mJournal->isActive()) return false;
+	if (mJournal->size() > qMin(MaxJournalSize, QFileInfo(fileName).size())) return false;
+
+	QElapsedTimer timer;
+	timer.start();
+	if (!mJournal->flush() || !mJournal->markSaved()) return false;
+
+	mProjectModifiedSinceLastSave = false;
+	mProjectModifiedSinceAutosave = false;
+	mAutosave->discardRecoveryFile();
+	setWindowTitle(makeWindowTitle(fileName, true));
+	showMessage(QString("Quick saved (journal is %1 KB, %2ms)").arg(mJournal->size() / 1024).arg(timer.elapsed()));
+	return true;
+}
+
 void MainWindow::exportProjectAs() {
 	QSettings settings;
 	QString dir = settings.value("last_export_dir", QDir::currentPath()).toString();
@@ -1153,7 +1363,97 @@ void MainWindow::exportProjectAs() {
 	}
 }
 
+void MainWindow::exportProjectAtlas() {
+	QSettings settings;
+	QString dir = settings.value("last_export_dir", QDir::currentPath()).toString();
+	QString dirName = QFileDialog::getExistingDirectory(this, "Export Atlas To...", dir);
+	if (dirName.isNull()) return;
+
+	AtlasOptions options;
+	QStringList pageSizes { "512", "1024", "2048", "4096" };
+	bool ok = false;
+	QString pageSize = QInputDialog::getItem(this, "Export Atlas", "Maximum page size:", pageSizes, pageSizes.indexOf(QString::number(options.maxPageSize)), false, &ok);
+	if (!ok) return;
+	options.maxPageSize = pageSize.toInt();
+	options.pagesPerFolder = QMessageBox::question(this, "Export Atlas", "Pack each folder into its own pages?") == QMessageBox::Yes;
+
+	bool result = ProjectModel::Instance()->exportAtlas(dirName, options);
+	if (!result) {
+		qWarning() << "Error during export";
+		qWarning() << mProjectModel->exportLog.join("\n");
+		QMessageBox::warning(this, "Error during export", tr("Couldn't export to ") + dirName + "!\n" + mProjectModel->exportLog.mid(0, 10).join("\n"));
+	}
+	else {
+		settings.setValue("last_export_dir", QDir(dirName).absolutePath());
+		MainWindow::Instance()->showMessage("Successfully exported atlas");
+		if (!mProjectModel->exportLog.isEmpty()) {
+			qWarning() << "Error during export";
+			qWarning() << mProjectModel->exportLog.join("\n");
+			QMessageBox::warning(this, "Export issues", mProjectModel->exportLog.mid(0, 10).join("\n"));
+		}
+	}
+}
+
+void MainWindow::autosaveProject() {
+	if (!mProjectModifiedSinceLastSave || !mProjectModifiedSinceAutosave) return;
+	if (mAutosave->save(*mProjectModel)) {
+		mProjectModifiedSinceAutosave = false;
+	}
+}
+
+void MainWindow::autosaveFinished(bool success, qint64 snapshotMs, qint64 writeMs, qint64 bytesWritten, const QString& error) {
+	if (success) {
+		qInfo() << QString("Autosaved to %1: %2 bytes, %3ms to take the snapshot, %4ms to write it in the background")
+			.arg(mAutosave->recoveryFileName()).arg(bytesWritten).arg(snapshotMs).arg(writeMs);
+		showMessage(QString("Autosaved (%1 KB, snapshot took %2ms)").arg(bytesWritten / 1024).arg(snapshotMs));
+	}
+	else {
+		qWarning() << "Autosave failed" << error;
+		mProjectModifiedSinceAutosave = true;
+	}
+}
+
+void MainWindow::recoverAutosavedProject() {
+	// Newest first, the ones that aren't opened stay for next time
+	for (const QString& recoveryFile : Autosave::orphanedRecoveryFiles()) {
+		const QString when = QFileInfo(recoveryFile).lastModified().toString(Qt::SystemLocaleShortDate);
+		QMessageBox::StandardButton button = QMessageBox::question(this, "Recover Project?",
+			QString("MQ Sprite didn't close properly. Open the project autosaved at %1?").arg(when));
+		if (button != QMessageBox::Yes) {
+			QFile::remove(recoveryFile);
+			continue;
+		}
+
+		// Load a copy, so autosaving doesn't have to replace the file the project is read from
+		const QString fileName = QFileInfo(recoveryFile).absoluteDir().filePath(QFileInfo(recoveryFile).fileName().replace("autosave-", "recovered-"));
+		QFile::remove(fileName);
+		if (!QFile::copy(recoveryFile, fileName)) {
+			QMessageBox::warning(this, "Error during recovery", tr("Couldn't copy ") + recoveryFile);
+			return;
+		}
+		loadProject(fileName);
+		if (PM()->fileName != fileName) return;
+		mJournal->stop(true);
+		QFile::remove(recoveryFile);
+
+		// It has to be saved somewhere else
+		PM()->fileName = QString();
+		mAutosave->setProject(QString());
+		mProjectModifiedSinceLastSave = true;
+		setWindowTitle(makeWindowTitle("recovered project", false));
+		return;
+	}
+}
+
 void MainWindow::undoStackIndexChanged(int){
+	mJournal->flush();
     mProjectModifiedSinceLastSave = true;
+	mProjectModifiedSinceAutosave = true;
 	setWindowTitle(makeWindowTitle(PM()->fileName, false));
 }
+
+void MainWindow::undoUsageChanged(qint64 usage, qint64 budget){
+	mUndoUsageLabel->setText(QString("Undo: %1 / %2 MB").arg(usage / 1048576.0, 0, 'f', 1).arg(budget >> 20));
+	mUndoUsageLabel->setToolTip(QString("Memory used by the frames kept for undo, %1 MB more are in a scratch file")
+		.arg(mUndoBudget->spilled() / 1048576.0, 0, 'f', 1));
+}
@@ -12,11 +12,17 @@
 #include "partwidget.h"
 #include "compositewidget.h"
 #include "partlist.h"
+#include "changebus.h"
 
 class CompositeToolsWidget;
 class DrawingTools;
 class PropertiesWidget;
 class AnimationWidget;
+class Autosave;
+class Journal;
+class UndoBudget;
+class QLabel;
+class QTimer;
 
 namespace Ui {
 class MainWindow;
@@ -31,17 +37,19 @@ public:
     ~MainWindow();
     static MainWindow* Instance();
     QUndoStack* undoStack(){return mUndoStack;}
+	UndoBudget* undoBudget(){return mUndoBudget;}
 
     void createActions();
     void createMenus();
     void showMessage(const QString& msg, int timeout=2000);
 
-    // Notifications from commands that something has changed in the project
+    // Notifications from commands that something has changed in the project. Most are
+    // collected in a ChangeBus and the views are updated once at the end of the turn.
     void partListChanged();
 	void newAssetCreated(AssetRef ref);
 
     void partRenamed(AssetRef ref, const QString& newName);
-    void partFrameUpdated(AssetRef ref, const QString& mode, int frame);
+    void partFrameUpdated(AssetRef ref, const QString& mode, int frame, const QRect& rect = QRect()); // the pixels in rect, or all of them
     void partFramesUpdated(AssetRef ref, const QString& mode);
     void partNumPivotsUpdated(AssetRef ref, const QString& mode);
     void partPropertiesUpdated(AssetRef ref);
@@ -63,6 +71,9 @@ protected:
 	void loadPreferences();
 	void savePreferences();
 	void updatePreferences();
+	void setAutosaveInterval(int minutes);
+	void closeProject();
+	bool quickSaveProject();
 
 public slots:
     void assetDoubleClicked(AssetRef ref);
@@ -97,8 +108,14 @@ public slots:
     void saveProject();
     void saveProjectAs();
 	void exportProjectAs();
+	void exportProjectAtlas();
+	void autosaveProject();
+	void autosaveFinished(bool success, qint64 snapshotMs, qint64 writeMs, qint64 bytesWritten, const QString& error);
+	void recoverAutosavedProject();
 
     void undoStackIndexChanged(int);
+	void undoUsageChanged(qint64 usage, qint64 budget);
+	void applyChanges(const ChangeBus::Changes& changes);
 
 private:
     Ui::MainWindow *ui = nullptr;
@@ -116,6 +133,9 @@ private:
 	AssetRef mSelectedAsset {};
 
     QUndoStack* mUndoStack = nullptr;
+	UndoBudget* mUndoBudget = nullptr;
+	ChangeBus* mChanges = nullptr;
+	QLabel* mUndoUsageLabel = nullptr;
     QMenu *mFileMenu = nullptr;
     QMenu *mEditMenu = nullptr;
     QMenu *mViewMenu = nullptr;
@@ -131,6 +151,12 @@ private:
 	QAction* mDuplicateAssetAction = nullptr;
 
     bool mProjectModifiedSinceLastSave = false;
+
+	Autosave* mAutosave = nullptr;
+	QTimer* mAutosaveTimer = nullptr;
+	bool mProjectModifiedSinceAutosave = false;
+
+	Journal* mJournal = nullptr;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,56 @@
+#ifndef MMPIXEL_PARALLEL_H
+#define MMPIXEL_PARALLEL_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <algorithm>
+#include <functional>
+
+// Calls fn(i) for every i in [0, count) on the global thread pool and returns
+// when all calls have finished. Workers pull indices from a shared counter so
+// uneven work is balanced, and the calling thread works too. This is safe to
+// call from a pool thread: workers that never got a thread are taken back.
+// NB: fn is called concurrently, so it must only touch per-index state.
+inline void ParallelFor(int count, const std::function<void(int)>& fn) {
+	if (count <= 0) return;
+
+	QAtomicInt next { 0 };
+	auto work = [&]() {
+		for (int i = next.fetchAndAddRelaxed(1); i < count; i = next.fetchAndAddRelaxed(1)) {
+			fn(i);
+		}
+	};
+
+	class Worker: public QRunnable {
+	public:
+		Worker(const std::function<void()>& work, QSemaphore* done) :mWork(work), mDone(done) { setAutoDelete(false); }
+		void run() override { mWork(); mDone->release(); }
+	private:
+		std::function<void()> mWork;
+		QSemaphore* mDone;
+	};
+
+	QThreadPool* pool = QThreadPool::globalInstance();
+	const int numWorkers = std::min(count, pool->maxThreadCount()) - 1;
+	QSemaphore done;
+	QList<Worker*> workers;
+	for (int i = 0; i < numWorkers; ++i) {
+		auto* worker = new Worker(work, &done);
+		workers.append(worker);
+		pool->start(worker);
+	}
+
+	work();
+
+	int started = 0;
+	for (auto* worker : workers) {
+		if (!pool->tryTake(worker)) started++;
+	}
+	done.acquire(started);
+	qDeleteAll(workers);
+}
+
+#endif
@@ -37,9 +37,7 @@ void PartList::updateIcon(AssetRef ref) {
 }
 
 void PartList::deselectAsset() {
-	for (auto* item : mAssetTreeWidget->selectedItems()) {
-		mAssetTreeWidget->setItemSelected(item, false);
-	}
+	mAssetTreeWidget->clearSelection();
 }
 
 void PartList::selectAsset(AssetRef ref) {
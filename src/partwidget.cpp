@@ -26,6 +26,30 @@
 #include <QQueue>
 #include <QToolButton>
 
+QImage FloodFill(const QImage& image, QPoint start, QRgb colour) {
+	QImage result = image.copy();
+	if (!result.rect().contains(start)) return result;
+
+	const QRgb targetColour = result.pixel(start);
+	if (targetColour == colour) return result;
+
+	QQueue<QPoint> q;
+	q.enqueue(start);
+	while (!q.isEmpty()) {
+		QPoint p = q.dequeue();
+		if (p.x() >= 0 && p.x() < result.width() && p.y() >= 0 && p.y() < result.height()) {
+			if (result.pixel(p) == targetColour) {
+				result.setPixel(p, colour);
+				q.enqueue(QPoint(p.x() + 1, p.y()));
+				q.enqueue(QPoint(p.x() - 1, p.y()));
+				q.enqueue(QPoint(p.x(), p.y() + 1));
+				q.enqueue(QPoint(p.x(), p.y() - 1));
+			}
+		}
+	}
+	return result;
+}
+
 PartWidget::PartWidget(AssetRef ref, QWidget *parent) :
 	QMdiSubWindow(parent, Qt::SubWindow),
     mPartRef(ref),
@@ -394,12 +418,62 @@ void PartWidget::partNameChanged(const QString& newPartName){
 	}
 }
 
-void PartWidget::partFrameUpdated(AssetRef part, const QString& mode, int /*frame*/){
+void PartWidget::partFrameUpdated(AssetRef part, const QString& mode, int frame, const QRect& rect){
     if (part==mPartRef && mModeName==mode){
-        buildScene();
+        if (!updateFrame(frame, rect)) buildScene();
     }
 }
 
+// Updates the pixmap, anchor and pivots of one frame in place, the pixmap only in rect
+// if it isn't null. Returns false if the scene doesn't match the mode anymore and has to
+// be rebuilt instead.
+bool PartWidget::updateFrame(int frame, const QRect& rect){
+    const Part* part = PM()->getPart(mPartRef);
+    if (!part || !part->modes.contains(mModeName)) return false;
+    const Part::Mode& m = part->modes[mModeName];
+    if (m.numFrames != mPixmapItems.size() || m.numPivots != mNumPivots || frame < 0 || frame >= m.numFrames) return false;
+
+    const Frame& image = m.frames.at(frame);
+    QGraphicsPixmapItem* pi = mPixmapItems.at(frame);
+    if (!image || image->size() != pi->pixmap().size()) return false;
+
+    const QRect dirty = rect.isNull() ? image->rect() : rect.intersected(image->rect());
+    if (!dirty.isEmpty()){
+        // The item lets go of its pixmap so painting on it doesn't make a copy
+        QPixmap pixmap = pi->pixmap();
+        pi->setPixmap(QPixmap());
+        {
+            QPainter painter(&pixmap);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.drawImage(dirty.topLeft(), *image, dirty);
+        }
+        pi->setPixmap(pixmap);
+    }
+
+    // Move the markers by as much as their points moved. NB: The first item of each is at
+    // the point itself, mAnchors and mPivots may already hold the new points (see partViewKeyPressEvent).
+    QRectF moved;
+    auto moveItems = [&moved](const QList<QAbstractGraphicsShapeItem*>& items, const QPoint& point){
+        if (items.isEmpty()) return;
+        const QPointF delta = QPointF(point) - items.first()->pos();
+        if (delta.isNull()) return;
+        for (auto* it : items){
+            it->moveBy(delta.x(), delta.y());
+            moved |= it->sceneBoundingRect();
+        }
+    };
+    moveItems(mAnchorItems.at(frame), m.anchor.at(frame));
+    mAnchors.replace(frame, m.anchor.at(frame));
+    for (int p = 0; p < Part::MaxPivots; p++){
+        moveItems(mPivotItems[p].at(frame), m.pivots[p].at(frame));
+        mPivots[p].replace(frame, m.pivots[p].at(frame));
+    }
+    if (!moved.isNull()){
+        mPartView->setSceneRect(mPartView->sceneRect().united(moved));
+    }
+    return true;
+}
+
 void PartWidget::partFramesUpdated(AssetRef part, const QString& mode){
     if (part==mPartRef && mModeName==mode){
         buildScene();
@@ -727,30 +801,11 @@ void PartWidget::partViewMousePressEvent(QMouseEvent *event){
         const auto img = mPart->modes[mModeName].frames.at(mFrameNumber);
 
         if (pi.x()>=0 && pi.x()<img->width() && pi.y()>=0 && pi.y()<img->height()){
-            QImage fillPattern = img->copy(); // (QSize(img->width(),img->height()), QImage::Format_ARGB32);
-            // fillPattern.fill(0x00000000);
-
-            QRgb targetColour = fillPattern.pixel(pi.x(),pi.y());
+            QRgb targetColour = img->pixel(pi.x(),pi.y());
             QRgb replacementColour = mPenColour.rgba();
 
             if (targetColour!=replacementColour){
-                QQueue<QPoint> q;
-                q.enqueue(pi);
-                while(!q.isEmpty()){
-                    QPoint p = q.dequeue();
-                   //  qDebug() << p;
-                    if (p.x()>=0 && p.x()<fillPattern.width() && p.y()>=0 && p.y()<fillPattern.height()){
-                        QRgb c = fillPattern.pixel(p);
-                        if (c==targetColour){
-                            fillPattern.setPixel(p, replacementColour);
-                            q.enqueue(QPoint(p.x()+1,p.y()));
-                            q.enqueue(QPoint(p.x()-1,p.y()));
-                            q.enqueue(QPoint(p.x(),p.y()+1));
-                            q.enqueue(QPoint(p.x(),p.y()-1));
-                        }
-                    }
-                }
-
+                QImage fillPattern = FloodFill(*img, pi, replacementColour);
                 TryCommand(new CDrawOnPart(mPartRef, mModeName, mFrameNumber, fillPattern, QPoint(0,0)));
             }
         }
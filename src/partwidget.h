@@ -13,6 +13,9 @@
 
 enum DrawToolType {kDrawToolPaint, kDrawToolEraser, kDrawToolPickColour, kDrawToolFill, kDrawToolStamp, kDrawToolCopy};
 
+// Returns a copy of image where the 4-connected area around start that has the colour of start is filled with colour
+QImage FloodFill(const QImage& image, QPoint start, QRgb colour);
+
 /////////////////////////////////////////////
 // PartView
 /////////////////////////////////////////////
@@ -55,7 +58,7 @@ public:
     void setMode(const QString& mode);
 
     void partNameChanged(const QString& newPartName);    
-    void partFrameUpdated(AssetRef part, const QString& mode, int frame);
+    void partFrameUpdated(AssetRef part, const QString& mode, int frame, const QRect& rect = QRect()); // the pixels in rect, or all of them
     void partFramesUpdated(AssetRef part, const QString& mode);
     void partNumPivotsUpdated(AssetRef part, const QString& mode);
     void partPropertiesChanged(AssetRef part);
@@ -64,6 +67,7 @@ public:
     void updatePropertiesOverlays();
     void updateOverlay();
     void buildScene();
+    bool updateFrame(int frame, const QRect& rect);
     void updateBackgroundBrushes();
 
     // setters
@@ -1,16 +1,28 @@
 #include "projectmodel.h"
 
 #include "zip.h"
+#include "parallel.h"
+#include "jsonreader.h"
+#include "atlaspacker.h"
+#include "xxhash.h"
 #include <QColor>
 #include <QDebug>
 #include <QPainter>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QVector>
 #include <QFile>
 #include <QTextStream>
-#include <QTemporaryFile>
+#include <QBuffer>
+#include <QDataStream>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QRegExp>
+#include <QSaveFile>
+#include <QSet>
+#include <QHash>
+#include <QtEndian>
 #include <algorithm>
 #include <cstdlib>
 #include <ctime>
@@ -21,6 +33,7 @@
 #include <ios>
 
 static const int ProjectFileVersion = 2;
+static const char* BinaryDataEntry = "data.bin";
 
 bool operator==(const AssetRef& a, const AssetRef& b){
     return (a.type == AssetType::None && b.type == AssetType::None) ||  (a.id == b.id && a.type == b.type);
@@ -43,21 +56,253 @@ Preferences& GlobalPreferences() {
 	return prefs;
 }
 
-static ProjectModel* sInstance = nullptr;
+Frame::Frame(QSharedPointer<QImage> image) {
+	if (image) {
+		d = QSharedPointer<Data>::create();
+		d->image = image;
+		d->loaded.storeRelease(image.data());
+	}
+}
+
+Frame::Frame(QSharedPointer<ZipReader> archive, const QString& entry) {
+	d = QSharedPointer<Data>::create();
+	d->archive = archive;
+	d->entry = entry;
+}
+
+QImage* Frame::data() const {
+	if (!d) return nullptr;
+
+	// Fast path, the image never changes once it has been decoded
+	QImage* image = d->loaded.loadAcquire();
+	if (image) return image;
+
+	QMutexLocker lock(&d->mutex);
+	if (!d->image) {
+		QByteArray png = d->png;
+		if (png.isNull() && d->archive) {
+			png = d->archive->read(d->entry);
+		}
+		auto img = QSharedPointer<QImage>::create();
+		if (!img->loadFromData(png, "PNG")) {
+			qWarning() << "Couldn't decode frame" << d->entry;
+		}
+		d->image = img;
+		d->png.clear();
+	}
+	d->loaded.storeRelease(d->image.data());
+	return d->image.data();
+}
+
+Frame Frame::sharedCopy() const {
+	Frame copy;
+	if (d) {
+		copy.d = QSharedPointer<Data>::create();
+		QMutexLocker lock(&d->mutex);
+		if (d->image) {
+			copy.d->image = QSharedPointer<QImage>::create(*d->image);
+			copy.d->loaded.storeRelease(copy.d->image.data());
+		}
+		copy.d->png = d->png;
+		copy.d->archive = d->archive;
+		copy.d->entry = d->entry;
+		copy.d->hash = d->hash;
+		copy.d->hashed = d->hashed;
+	}
+	return copy;
+}
+
+quint64 Frame::contentHash() const {
+	if (!d) return 0;
+	const QImage& image = *data();
+	QMutexLocker lock(&d->mutex);
+	if (!d->hashed) {
+		quint64 h = XXH64(nullptr, 0, ((quint64) image.width() << 32) ^ ((quint64) image.height() << 8) ^ (quint64) image.format());
+		const int lineBytes = (image.width() * image.depth() + 7) / 8;
+		for (int y = 0; y < image.height(); y++) {
+			h = XXH64(image.constScanLine(y), lineBytes, h);
+		}
+		d->hash = h;
+		d->hashed = true;
+	}
+	return d->hash;
+}
+
+qint64 Frame::memorySize() const {
+	if (!d) return 0;
+	QMutexLocker lock(&d->mutex);
+	if (d->image) return d->image->sizeInBytes();
+	return d->png.size();
+}
+
+QByteArray Frame::encoded() const {
+	if (!d) return {};
+	{
+		QMutexLocker lock(&d->mutex);
+		if (!d->image) {
+			return d->png.isNull() && d->archive ? d->archive->read(d->entry) : d->png;
+		}
+	}
+	QByteArray png;
+	QBuffer buffer(&png);
+	buffer.open(QIODevice::WriteOnly);
+	if (!data()->save(&buffer, "PNG")) {
+		qWarning() << "Couldn't encode frame";
+		return {};
+	}
+	return png;
+}
+
+Frame Frame::fromEncoded(const QByteArray& png) {
+	Frame frame;
+	frame.d = QSharedPointer<Data>::create();
+	frame.d->png = png;
+	return frame;
+}
+
+void Frame::adoptDecoded(const Frame& copy) const {
+	if (!d || !copy.isLoaded() || copy.d == d) return;
+	QImage image;
+	quint64 hash;
+	bool hashed;
+	{
+		QMutexLocker lock(&copy.d->mutex);
+		image = *copy.d->image;
+		hash = copy.d->hash;
+		hashed = copy.d->hashed;
+	}
+	if (image.isNull()) return;
+
+	QMutexLocker lock(&d->mutex);
+	if (d->image) return;
+	d->image = QSharedPointer<QImage>::create(image);
+	d->png.clear();
+	d->hash = hash;
+	d->hashed = hashed;
+	d->loaded.storeRelease(d->image.data());
+}
+
+// The images written by save() and the exporters, by entry name. Identical frames are
+// stored once, in the entry of the first of them that was added.
+class ImageTable {
+public:
+	explicit ImageTable(const QSharedPointer<ZipReader>& archive = {}):mArchive(archive) {}
+
+	// Returns the entry frame is stored in, name if it's not identical to an earlier frame
+	QString add(const QString& name, const Frame& frame);
+
+	// Entry -> frames stored in it
+	const QMap<QString, QVector<Frame>>& entries() const { return mEntries; }
+	int shared() const { return mShared; }
+
+	// The entry in archive that holds an unchanged copy of frame, if any
+	static QString sourceEntry(const Frame& frame, const QSharedPointer<ZipReader>& archive);
+
+private:
+	// The CRC-32 and size of the PNG of a frame that isn't decoded, without reading it if it's in an archive
+	static bool encodedKey(const Frame& frame, quint64* key);
+
+	QSharedPointer<ZipReader> mArchive;
+	QMap<QString, QVector<Frame>> mEntries;
+	QHash<const void*, QString> mByData; // the same frame
+	QHash<QString, QString> mBySource; // an unchanged copy of the same archive entry
+	QMultiHash<quint64, QString> mByHash; // the same pixels
+	QMultiHash<quint64, QString> mByEncoded; // the same PNG
+	int mShared = 0;
+};
+
+QString ImageTable::sourceEntry(const Frame& frame, const QSharedPointer<ZipReader>& archive) {
+	if (archive && frame.d->archive == archive) {
+		return frame.d->entry;
+	}
+	return {};
+}
+
+bool ImageTable::encodedKey(const Frame& frame, quint64* key) {
+	QMutexLocker lock(&frame.d->mutex);
+	if (frame.d->image) return false;
+
+	quint32 crc = 0;
+	qint64 size = 0;
+	if (!frame.d->png.isNull()) {
+		crc = ZipCrc32(frame.d->png);
+		size = frame.d->png.size();
+	}
+	else if (!frame.d->archive || !frame.d->archive->stat(frame.d->entry, &crc, &size)) {
+		return false;
+	}
+	*key = ((quint64) size << 32) ^ crc;
+	return true;
+}
+
+QString ImageTable::add(const QString& name, const Frame& frame) {
+	if (!frame) return name;
+
+	QString entry = mByData.value(frame.d.data());
+	const QString source = sourceEntry(frame, mArchive);
+	if (entry.isEmpty() && !source.isEmpty()) {
+		entry = mBySource.value(source);
+	}
+
+	// Decoded frames are compared by their pixels, others by their PNGs so they don't have to be decoded.
+	// Identical PNGs have identical pixels, but a frame that's decoded and one that isn't are never merged.
+	quint64 h = 0;
+	quint64 key = 0;
+	bool hasKey = false;
+	if (entry.isEmpty() && frame.isLoaded()) {
+		h = frame.contentHash();
+		for (const auto& candidate : mByHash.values(h)) {
+			const Frame& other = mEntries.value(candidate).first();
+			if (*other == *frame) {
+				entry = candidate;
+				break;
+			}
+		}
+	}
+	else if (entry.isEmpty() && encodedKey(frame, &key)) {
+		hasKey = true;
+		QByteArray png;
+		for (const auto& candidate : mByEncoded.values(key)) {
+			if (png.isNull()) png = frame.encoded();
+			if (mEntries.value(candidate).first().encoded() == png) {
+				entry = candidate;
+				break;
+			}
+		}
+	}
+
+	if (entry.isEmpty()) {
+		entry = name;
+		if (frame.isLoaded()) mByHash.insert(h, entry);
+		else if (hasKey) mByEncoded.insert(key, entry);
+	}
+	else {
+		mShared++;
+	}
+	if (!source.isEmpty()) mBySource.insert(source, entry);
+	mByData.insert(frame.d.data(), entry);
+	mEntries[entry].append(frame);
+	return entry;
+}
+
+// The first model created is the global one, the command line tool creates
+// more (on several threads) to process files independently
+static QAtomicPointer<ProjectModel> sInstance { nullptr };
 
 ProjectModel* PM(){return ProjectModel::Instance();}
 
 ProjectModel::ProjectModel()
 {
-	sInstance = this;
+	sInstance.testAndSetOrdered(nullptr, this);
 }
 
 ProjectModel::~ProjectModel() {
 	clear();
+	sInstance.testAndSetOrdered(this, nullptr);
 }
 
 ProjectModel* ProjectModel::Instance() {
-	return sInstance;
+	return sInstance.loadAcquire();
 }
 
 AssetRef ProjectModel::createAssetRef(AssetType type) {
@@ -81,7 +326,7 @@ bool ProjectModel::hasAsset(const AssetRef& ref) {
 }
 
 Part* ProjectModel::getPart(const AssetRef& uuid) {
-	return parts.value(uuid).data();
+	return parts.get(uuid);
 }
 
 bool ProjectModel::hasPart(const AssetRef& uuid) {
@@ -89,7 +334,7 @@ bool ProjectModel::hasPart(const AssetRef& uuid) {
 }
 
 Composite* ProjectModel::getComposite(const AssetRef& uuid) {
-	return composites.value(uuid).data();
+	return composites.get(uuid);
 }
 
 bool ProjectModel::hasComposite(const AssetRef& uuid) {
@@ -97,48 +342,229 @@ bool ProjectModel::hasComposite(const AssetRef& uuid) {
 }
 
 Folder* ProjectModel::getFolder(const AssetRef& uuid) {
-	return folders.value(uuid).data();
+	return folders.get(uuid);
 }
 
 bool ProjectModel::hasFolder(const AssetRef& uuid) {
 	return getFolder(uuid) != nullptr;
 }
 
-Part* ProjectModel::findPartByName(const QString& name) {
-	for (auto p : parts.values()) {
-		if (p->name == name) {
-			return p.data();
-		}
+QMultiHash<QString, AssetRef>& ProjectModel::nameIndex(AssetType type) {
+	switch (type) {
+	case AssetType::Composite: return mCompositeNames;
+	case AssetType::Folder: return mFolderNames;
+	default: return mPartNames;
 	}
-	return nullptr;
 }
 
-Composite* ProjectModel::findCompositeByName(const QString& name) {
-	for (auto p : composites.values()) {
-		if (p->name == name) {
-			return p.data();
+static AssetRef ParentKey(const AssetRef& parent) {
+	return parent.isNull() ? AssetRef() : parent;
+}
+
+void ProjectModel::ensureIndexes() {
+	if (mIndexesValid) return;
+	mPartNames.clear();
+	mCompositeNames.clear();
+	mFolderNames.clear();
+	mChildren.clear();
+	mFolderPaths.clear();
+	for (const auto& folder : folders) {
+		mFolderNames.insert(folder->name, folder->ref);
+		mChildren[ParentKey(folder->parent)].append(folder->ref);
+	}
+	for (const auto& comp : composites) {
+		mCompositeNames.insert(comp->name, comp->ref);
+		mChildren[ParentKey(comp->parent)].append(comp->ref);
+	}
+	for (const auto& part : parts) {
+		mPartNames.insert(part->name, part->ref);
+		mChildren[ParentKey(part->parent)].append(part->ref);
+	}
+	mIndexesValid = true;
+}
+
+void ProjectModel::invalidateIndexes() {
+	mIndexesValid = false;
+	mFolderPaths.clear();
+}
+
+Asset* ProjectModel::findAssetByName(AssetType type, const QString& name) {
+	ensureIndexes();
+	for (int attempt = 0; attempt < 2; attempt++) {
+		const auto& index = nameIndex(type);
+		Asset* found = nullptr;
+		AssetRef foundRef;
+		bool stale = false;
+		for (auto it = index.find(name); it != index.end() && it.key() == name; ++it) {
+			Asset* asset = getAsset(it.value());
+			if (!asset || asset->name != name) {
+				stale = true;
+				break;
+			}
+			// The first one in the map, as when the map was searched
+			if (!found || it.value() < foundRef) {
+				found = asset;
+				foundRef = it.value();
+			}
 		}
+		if (!stale) return found;
+
+		qWarning() << "Assets were changed without updating the name index";
+		invalidateIndexes();
+		ensureIndexes();
 	}
 	return nullptr;
 }
 
+Part* ProjectModel::findPartByName(const QString& name) {
+	return static_cast<Part*>(findAssetByName(AssetType::Part, name));
+}
+
+Composite* ProjectModel::findCompositeByName(const QString& name) {
+	return static_cast<Composite*>(findAssetByName(AssetType::Composite, name));
+}
+
 Folder* ProjectModel::findFolderByName(const QString& name) {
-	for (auto f : folders.values()) {
-		if (f->name == name) {
-			return f.data();
-		}
+	return static_cast<Folder*>(findAssetByName(AssetType::Folder, name));
+}
+
+QString ProjectModel::uniqueName(AssetType type, const QString& name, int number) {
+	ensureIndexes();
+	const auto& index = nameIndex(type);
+	auto numbered = [&](int n) -> QString {
+		return n == 0 ? name : name + "_" + QString::number(n);
+	};
+
+	// Copying the same asset again continues after the last number handed out, as long
+	// as that name is still taken, instead of trying every number from the start
+	const QPair<int, QString> key((int) type, name);
+	if (index.contains(numbered(number))) {
+		const int next = mNextNameNumber.value(key, 0);
+		if (next > number && index.contains(numbered(next - 1))) number = next;
+		while (index.contains(numbered(number))) number++;
 	}
-	return nullptr;
+	mNextNameNumber.insert(key, number + 1);
+	return numbered(number);
 }
 
-void ProjectModel::resetImageCache(QImage* img) {
-	auto it = mImageCache.find(img);
-	if (it != mImageCache.end()) {
-		if (QFile::exists(it.value())) {
-			QFile::remove(it.value());
+template <class T>
+void ProjectModel::insertAsset(SlotMap<AssetRef, T>& map, const QSharedPointer<T>& asset) {
+	if (mIndexesValid) {
+		auto& names = nameIndex(asset->ref.type);
+		if (const T* old = map.get(asset->ref)) {
+			names.remove(old->name, old->ref);
+			removeChild(old->parent, old->ref);
 		}
-		mImageCache.erase(it);
+		names.insert(asset->name, asset->ref);
+		mChildren[ParentKey(asset->parent)].append(asset->ref);
+	}
+	map.insert(asset->ref, asset);
+}
+
+template <class T>
+QSharedPointer<T> ProjectModel::takeAsset(SlotMap<AssetRef, T>& map, const AssetRef& ref) {
+	auto asset = map.take(ref);
+	if (asset && mIndexesValid) {
+		nameIndex(ref.type).remove(asset->name, ref);
+		removeChild(asset->parent, ref);
+	}
+	return asset;
+}
+
+void ProjectModel::removeChild(const AssetRef& parent, const AssetRef& ref) {
+	auto it = mChildren.find(ParentKey(parent));
+	if (it == mChildren.end()) return;
+	it.value().removeOne(ref);
+	if (it.value().isEmpty()) mChildren.erase(it);
+}
+
+void ProjectModel::insertPart(const QSharedPointer<Part>& part) {
+	insertAsset(parts, part);
+}
+
+void ProjectModel::insertComposite(const QSharedPointer<Composite>& comp) {
+	insertAsset(composites, comp);
+}
+
+void ProjectModel::insertFolder(const QSharedPointer<Folder>& folder) {
+	insertAsset(folders, folder);
+	mFolderPaths.clear();
+}
+
+QSharedPointer<Part> ProjectModel::takePart(const AssetRef& ref) {
+	return takeAsset(parts, ref);
+}
+
+QSharedPointer<Composite> ProjectModel::takeComposite(const AssetRef& ref) {
+	return takeAsset(composites, ref);
+}
+
+QSharedPointer<Folder> ProjectModel::takeFolder(const AssetRef& ref) {
+	mFolderPaths.clear();
+	return takeAsset(folders, ref);
+}
+
+void ProjectModel::renameAsset(const AssetRef& ref, const QString& name) {
+	Asset* asset = getAsset(ref);
+	if (!asset) return;
+	if (mIndexesValid) {
+		auto& index = nameIndex(ref.type);
+		index.remove(asset->name, ref);
+		index.insert(name, ref);
+	}
+	if (ref.type == AssetType::Folder) mFolderPaths.clear();
+	asset->name = name;
+}
+
+void ProjectModel::moveAsset(const AssetRef& ref, const AssetRef& parent) {
+	Asset* asset = getAsset(ref);
+	if (!asset) return;
+	if (mIndexesValid) {
+		removeChild(asset->parent, ref);
+		mChildren[ParentKey(parent)].append(ref);
 	}
+	if (ref.type == AssetType::Folder) mFolderPaths.clear();
+	asset->parent = parent;
+}
+
+QVector<AssetRef> ProjectModel::children(const AssetRef& folder) {
+	ensureIndexes();
+	return mChildren.value(ParentKey(folder));
+}
+
+QStringList ProjectModel::folderPath(const AssetRef& folder) {
+	auto it = mFolderPaths.constFind(folder);
+	if (it != mFolderPaths.constEnd()) return it.value();
+
+	QStringList path;
+	const Folder* f = getFolder(folder);
+	// Stops at a folder that's missing, or at a cycle, which only an edited file can have
+	for (int depth = 0; f && depth <= folders.size(); depth++) {
+		path.prepend(f->name);
+		f = getFolder(f->parent);
+	}
+	mFolderPaths.insert(folder, path);
+	return path;
+}
+
+void ProjectModel::resetImageCache(const Frame& frame) {
+	if (frame.d) {
+		// Make sure the image is decoded before forgetting where it came from
+		frame.data();
+		QMutexLocker lock(&frame.d->mutex);
+		frame.d->archive.clear();
+		frame.d->entry.clear();
+		frame.d->hashed = false;
+	}
+}
+
+Frame ProjectModel::sharedCopy(const Frame& frame) {
+	Frame copy = frame.sharedCopy();
+	if (copy.d && !copy.isLoaded()) {
+		// See replaceArchive()
+		mArchiveFrames.append(copy.d);
+	}
+	return copy;
 }
 
 void ProjectModel::clear() {
@@ -147,255 +573,669 @@ void ProjectModel::clear() {
 	folders.clear();
 	fileName = QString();
 	clearImageCache();
+	invalidateIndexes();
+	mNextNameNumber.clear();
 	mNextId = 0;
+}
 
-	for (auto file : mJunkFiles) {
-		QFile::remove(file);
-	}
-	mJunkFiles.clear();
+static QString frameImageName(const QString& imageNamePrefix, QString modeName, int frame) {
+	modeName.replace(' ', '_');
+	QString frameNum = QString("%1").arg(frame, 3, 10, QChar('0')).toUpper();
+	return QString("images/%1_%2_%3.png").arg(imageNamePrefix, modeName, frameNum);
 }
 
-static void removeAdditionalNullChars(QByteArray& arr) {
-	int length = 0;
-	for (int i = 0; i < arr.length(); ++i) {
-		if (arr[i] == '\0') {
-			length = i;
-			break;
-		}
-	}
-	if (length != 0) arr.resize(length);
+// The size of a PNG from its header (the signature and IHDR), or an invalid size if it isn't one
+static QSize pngSize(const QByteArray& head) {
+	static const char signature[] = "\x89PNG\r\n\x1a\n";
+	if (head.size() < 24 || !head.startsWith(QByteArray(signature, 8)) || head.mid(12, 4) != "IHDR") return {};
+	auto* p = reinterpret_cast<const uchar*>(head.constData());
+	return QSize(qFromBigEndian<quint32>(p + 16), qFromBigEndian<quint32>(p + 20));
 }
 
 bool ProjectModel::load(const QString& fileName, QString& reason) {
 	clearImageCache();
 	importLog.clear();
 	mNextId = 0;
+
+	QElapsedTimer timer;
+	timer.start();
 	
-	auto fileMap = LoadZipToFiles(fileName);
-	if (fileMap.isEmpty()) {
+	// Only the central directory and the project data are read here, frames are read from the archive when needed
+	auto archive = QSharedPointer<ZipReader>::create();
+	if (!archive->open(fileName)) {
 		reason = "Cannot open file!";
 		return false;
 	}
 
-	if (fileMap.count("data.json") == 0) {
-		reason = "Internal data.json is missing";
-		return false;
+	// Create a frame for every image (and store them in an image map)
+	// The frames are shared with the sprites when they're loaded
+	QMap<QString, Frame> imageMap;
+	for (const auto& entry : archive->entries()) {
+		if (entry.endsWith(".png")) {
+			Frame frame(archive, entry);
+			imageMap.insert(entry, frame);
+			mArchiveFrames.append(frame.d);
+		}
 	}
 
-	QFile dataJson(fileMap["data.json"]);
-	if (!dataJson.open(QIODevice::ReadOnly)) {
-		reason = "Couldn't load data.json";
-		return false;
+	if (!GlobalPreferences().lazyLoadFrames) {
+		// Decoding is independent per image so spread it over all cores
+		const QVector<Frame> frames = imageMap.values().toVector();
+		ParallelFor(frames.size(), [&](int i) {
+			frames.at(i).data();
+		});
+
+		for (auto it = imageMap.begin(); it != imageMap.end(); ++it) {
+			if (it.value()->isNull()) {
+				reason = "Couldn't load " + it.key();
+				return false;
+			}
+		}
 	}
-	auto dataRec = dataJson.readAll();
-	removeAdditionalNullChars(dataRec);
+	else {
+		// The frames are still checked against the size of their modes, from the PNG headers
+		const QStringList entries = imageMap.keys();
+		QVector<QSize> sizes(entries.size());
+		QSize* sizesData = sizes.data();
+		ParallelFor(entries.size(), [&](int i) {
+			sizesData[i] = pngSize(archive->readHead(entries.at(i), 24));
+		});
+
+		mEntrySizes.clear();
+		for (int i = 0; i < entries.size(); i++) {
+			if (!sizes.at(i).isValid()) {
+				reason = "Couldn't load " + entries.at(i);
+				return false;
+			}
+			mEntrySizes.insert(entries.at(i), sizes.at(i));
+		}
+	}
+	const qint64 decodeTime = timer.elapsed();
+
+	bool ok = false;
+	if (archive->contains(BinaryDataEntry)) {
+		ok = binaryToProject(archive->read(BinaryDataEntry), imageMap, reason);
+	}
+	else if (!archive->contains("data.json")) {
+		reason = "Internal data.json is missing";
+	}
+	else {
+		ok = jsonToProject(archive->read("data.json"), imageMap, reason);
+	}
+	mEntrySizes.clear();
+	if (!ok) return false;
+
+	mArchive = archive;
+	this->fileName = fileName;
+	invalidateIndexes();
+	qInfo() << QString("Loaded %1 images from %2 in %3ms (%4ms %5)").arg(imageMap.size()).arg(fileName).arg(timer.elapsed()).arg(decodeTime)
+		.arg(GlobalPreferences().lazyLoadFrames ? "indexing, frames are decoded on demand" : "indexing and decoding");
+	return true;
+}
+
+// Identical frames are stored once, so several frame records can refer to the same image.
+// Every record gets its own handle so they can still be edited separately.
+Frame ProjectModel::takeFrame(QMap<QString, Frame>& imageMap, const QString& imageName) {
+	auto it = imageMap.find(imageName);
+	if (it == imageMap.end()) return {};
+
+	Frame frame = it.value();
+	it.value() = sharedCopy(frame);
+	return frame;
+}
 
-	QJsonParseError error;
-	QJsonDocument dataDoc = QJsonDocument::fromJson(dataRec, &error);
+// data.json is read with a JsonReader, so the records are built as the document is
+// parsed instead of from a QJsonDocument holding another copy of all of it
+bool ProjectModel::jsonToProject(const QByteArray& data, QMap<QString, Frame>& imageMap, QString& reason) {
+	JsonReader reader(data);
 
 	auto buildErrorString = [&](QString reason) -> QString {
-		QStringList list { reason + ": " + error.errorString() };
-		if (error.offset >= 0 && error.offset < dataRec.length()) {
-			auto start = std::next(dataRec.data() + std::max(0, error.offset - 20));
-			auto end = std::next(dataRec.data() + std::min(dataRec.length() - 1, error.offset + 20));
-			if (start < end) {
-				list.append("Context: ");
-				list.append(QString::fromUtf8(start, std::distance(start, end)));
-			}
+		if (!reader.hasError()) return reason;
+		QStringList list { reason + ": " + reader.errorString() + QString(" at offset %1").arg(reader.offset()) };
+		const int start = std::max(0, reader.offset() - 20);
+		const int end = std::min(data.length(), reader.offset() + 20);
+		if (start < end) {
+			list.append("Context: ");
+			list.append(QString::fromUtf8(data.constData() + start, end - start));
 		}
 		return list.join("\n");
 	};
 
-	if (error.error != QJsonParseError::NoError) {
-		reason = buildErrorString("Internal data.json parse error");
+	if (!reader.readStartObject()) {
+		reason = buildErrorString(reader.hasError() ? "Internal data.json parse error" : "Internal data.json is not a valid json object");
 		return false;
 	}
-	else if (dataDoc.isNull() || dataDoc.isEmpty() || !dataDoc.isObject()) {
-		reason = buildErrorString("Internal data.json is not a valid json object");
+
+	// Keys are written in alphabetical order so the version comes last, nothing is added until it's checked
+	bool hasVersion = false;
+	int version = 0;
+	QList<QSharedPointer<Folder>> folders;
+	QList<QSharedPointer<Part>> parts;
+	QList<QSharedPointer<Composite>> comps;
+	while (reader.readMember()) {
+		if (reader.keyIs("version")) {
+			hasVersion = true;
+			version = reader.readInt();
+		}
+		else if (reader.keyIs("folders") && reader.readStartArray()) {
+			while (reader.readElement()) {
+				if (reader.token() != JsonReader::StartObject) {
+					reader.skipCurrent();
+					continue;
+				}
+				auto folder = QSharedPointer<Folder>::create();
+				jsonToFolder(reader, folder.get());
+				folders.append(folder);
+			}
+		}
+		else if (reader.keyIs("parts") && reader.readStartArray()) {
+			while (reader.readElement()) {
+				if (reader.token() != JsonReader::StartObject) {
+					reader.skipCurrent();
+					continue;
+				}
+				auto part = QSharedPointer<Part>::create();
+				jsonToPart(reader, imageMap, part.get());
+				parts.append(part);
+			}
+		}
+		else if (reader.keyIs("comps") && reader.readStartArray()) {
+			while (reader.readElement()) {
+				if (reader.token() != JsonReader::StartObject) {
+					reader.skipCurrent();
+					continue;
+				}
+				auto composite = QSharedPointer<Composite>::create();
+				jsonToComposite(reader, composite.get());
+				comps.append(composite);
+			}
+		}
+		else if (reader.token() == JsonReader::Key) {
+			reader.skipValue();
+		}
+	}
+	if (!reader.hasError()) reader.readNext(); // nothing but whitespace may follow
+	if (reader.hasError()) {
+		reason = buildErrorString("Internal data.json parse error");
 		return false;
 	}
 
-	QJsonObject dataObj = dataDoc.object();
-	if (!dataObj.contains("version")) {
+	if (!hasVersion) {
 		reason = buildErrorString("Internal data.json has no version field");
 		return false;
 	}
 
-	if (dataObj.value("version").toInt(0) != ProjectFileVersion) {
+	if (version != ProjectFileVersion) {
 		reason = buildErrorString("Internal data.json has an invalid version");
 		return false;
 	}
 
-	// Load all the images (and store them in an image map)
-	// The ownership of these are taken by the sprites when they're loaded
-	QMap<QString, QSharedPointer<QImage>> imageMap;
-	
-	for (auto it = fileMap.begin(); it != fileMap.end(); it++) {
-		QString assetName = it.key();
-		if (assetName.endsWith(".png")) {
-			auto img = QSharedPointer<QImage>::create();
-			bool res = img->load(it.value(), "PNG");
-			if (!res) {
-				reason = "Couldn't load " + it.value();
-				return false;
+	for (const auto& folder : folders) {
+		mNextId = std::max(mNextId, folder->ref.id + 1);
+		this->folders.insert(folder->ref, folder);
+	}
+	for (const auto& part : parts) {
+		mNextId = std::max(mNextId, part->ref.id + 1);
+		this->parts.insert(part->ref, part);
+	}
+	for (const auto& composite : comps) {
+		mNextId = std::max(mNextId, composite->ref.id + 1);
+		this->composites.insert(composite->ref, composite);
+	}
+
+	return true;
+}
+
+QByteArray ProjectModel::projectToJson(ImageTable* images) {
+	QJsonObject data;
+	data.insert("version", ProjectFileVersion);
+
+	QJsonArray foldersArray;
+	for (auto folder : folders) {
+		QJsonObject folderObject;
+		folderObject.insert("id", folder->ref.id);
+		folderToJson(folder->name, *folder, &folderObject);
+		foldersArray.append(folderObject);
+	}
+	data.insert("folders", foldersArray);
+
+	QJsonArray partsArray;
+	for (auto part : parts) {
+		QJsonObject partObject;
+		partObject.insert("id", part->ref.id);
+		partToJson(part->name, *part, &partObject, images);
+		partsArray.append(partObject);
+	}
+	data.insert("parts", partsArray);
+
+	QJsonArray compArray;
+	for (auto comp: composites) {
+		QJsonObject compObject;
+		compObject.insert("id", comp->ref.id);
+		compositeToJson(comp->name, *comp, &compObject);
+		compArray.append(compObject);
+	}
+	data.insert("comps", compArray);
+
+	QJsonDocument doc(data);
+	return doc.toJson();
+}
+
+// The binary project data is a little endian QDataStream:
+//   header:     magic, version
+//   folders:    count, then per folder: id, parent, name
+//   parts:      count, then per part: id, parent, name, properties, mode count, then per mode:
+//                 name, width, height, numFrames, numPivots, framesPerSecond,
+//                 numFrames image names, numFrames anchors (x, y),
+//                 numPivots arrays of numFrames pivots (x, y)
+//   composites: count, then per composite: id, parent, name, properties, root, child count, then per child:
+//                 name, id, part, parent, parentPivot, z, child count, children
+// Ids and indices are qint32 (-1 if unset), counts are quint32 and strings are UTF-8 QByteArrays.
+// Unlike data.json, properties are stored as edited and read back without reformatting.
+static const quint32 BinaryDataMagic = 0x4253514D; // "MQSB"
+static const quint32 BinaryDataVersion = 1;
+
+static qint32 binaryRef(const AssetRef& ref) {
+	return ref.isNull() ? -1 : ref.id;
+}
+
+QByteArray ProjectModel::projectToBinary(ImageTable* images) {
+	QByteArray data;
+	QDataStream out(&data, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_5_0);
+	out.setByteOrder(QDataStream::LittleEndian);
+	out << BinaryDataMagic << BinaryDataVersion;
+
+	out << (quint32) folders.size();
+	for (const auto& folder : folders) {
+		out << (qint32) folder->ref.id << binaryRef(folder->parent) << folder->name.toUtf8();
+	}
+
+	out << (quint32) parts.size();
+	for (const auto& part : parts) {
+		out << (qint32) part->ref.id << binaryRef(part->parent) << part->name.toUtf8() << part->properties.toUtf8();
+
+		const QString imageNamePrefix = imageNamePrefixForPart(part->name, *part);
+		out << (quint32) part->modes.size();
+		for (auto mit = part->modes.begin(); mit != part->modes.end(); ++mit) {
+			const auto& m = mit.value();
+			out << mit.key().toUtf8();
+			out << (qint32) m.width << (qint32) m.height << (qint32) m.numFrames << (qint32) m.numPivots << (qint32) m.framesPerSecond;
+			for (int frame = 0; frame < m.numFrames; frame++) {
+				QString imageName = images->add(frameImageName(imageNamePrefix, mit.key(), frame), m.frames.at(frame));
+				out << imageName.toUtf8();
+			}
+			for (int frame = 0; frame < m.numFrames; frame++) {
+				out << (qint32) m.anchor.at(frame).x() << (qint32) m.anchor.at(frame).y();
+			}
+			for (int p = 0; p < m.numPivots; p++) {
+				for (int frame = 0; frame < m.numFrames; frame++) {
+					out << (qint32) m.pivots[p].at(frame).x() << (qint32) m.pivots[p].at(frame).y();
+				}
 			}
-			imageMap.insert(assetName, img);
-			mImageCache.insert(img.get(), it.value());
 		}
 	}
 
-	auto folders = dataObj.value("folders").toArray();
-	auto parts = dataObj.value("parts").toArray();
-	auto comps = dataObj.value("comps").toArray();
+	out << (quint32) composites.size();
+	for (const auto& comp : composites) {
+		out << (qint32) comp->ref.id << binaryRef(comp->parent) << comp->name.toUtf8() << comp->properties.toUtf8();
+		out << (qint32) comp->root << (quint32) comp->children.size();
+		for (const auto& childName : comp->children) {
+			const auto& child = comp->childrenMap.value(childName);
+			out << childName.toUtf8();
+			out << (qint32) child.id << binaryRef(child.part) << (qint32) child.parent << (qint32) child.parentPivot << (qint32) child.z;
+			out << (quint32) child.children.size();
+			for (int ci : child.children) {
+				out << (qint32) ci;
+			}
+		}
+	}
+	return data;
+}
+
+bool ProjectModel::binaryToProject(const QByteArray& data, QMap<QString, Frame>& imageMap, QString& reason) {
+	QDataStream in(data);
+	in.setVersion(QDataStream::Qt_5_0);
+	in.setByteOrder(QDataStream::LittleEndian);
+
+	quint32 magic = 0, version = 0;
+	in >> magic >> version;
+	if (magic != BinaryDataMagic) {
+		reason = "Internal data.bin is not a project";
+		return false;
+	}
+	if (version != BinaryDataVersion) {
+		reason = "Internal data.bin has an invalid version";
+		return false;
+	}
 
-	if (!folders.isEmpty()) {
-		for (auto it = folders.begin(); it != folders.end(); it++) {
-			const auto& obj = it->toObject();
-			auto folder = QSharedPointer<Folder>::create();
-			folder->ref.id = obj["id"].toInt();
-			folder->ref.type = AssetType::Folder;
-			mNextId = std::max(mNextId, folder->ref.id + 1);
-			jsonToFolder(obj, folder.get());
-			this->folders.insert(folder->ref, folder);
+	auto readString = [&]() -> QString {
+		QByteArray str;
+		in >> str;
+		return QString::fromUtf8(str);
+	};
+	auto readRef = [&](AssetType type) -> AssetRef {
+		qint32 id = -1;
+		in >> id;
+		AssetRef ref;
+		if (id >= 0) {
+			ref.id = id;
+			ref.type = type;
 		}
+		return ref;
+	};
+	auto readPoint = [&]() -> QPoint {
+		qint32 x = 0, y = 0;
+		in >> x >> y;
+		return QPoint(x, y);
+	};
+	// A count can't be larger than the bytes left, this catches corrupt counts before anything is allocated
+	auto readCount = [&]() -> int {
+		quint32 count = 0;
+		in >> count;
+		if (in.status() != QDataStream::Ok || count > (quint32) (data.size() - in.device()->pos())) {
+			in.setStatus(QDataStream::ReadCorruptData);
+			return 0;
+		}
+		return (int) count;
+	};
+
+	int numFolders = readCount();
+	for (int i = 0; i < numFolders && in.status() == QDataStream::Ok; i++) {
+		auto folder = QSharedPointer<Folder>::create();
+		folder->ref = readRef(AssetType::Folder);
+		folder->parent = readRef(AssetType::Folder);
+		folder->name = readString();
+		mNextId = std::max(mNextId, folder->ref.id + 1);
+		this->folders.insert(folder->ref, folder);
 	}
 
-	if (!parts.isEmpty()) {
-		for (auto it = parts.begin(); it != parts.end(); it++) {
-			const auto& partObj = it->toObject();
-			auto part = QSharedPointer<Part>::create();
-			part->ref.id = partObj["id"].toInt();
-			part->ref.type = AssetType::Part;
-			mNextId = std::max(mNextId, part->ref.id + 1);
-			jsonToPart(partObj, imageMap, part.get());
-			this->parts.insert(part->ref, part);
+	int numParts = readCount();
+	for (int i = 0; i < numParts && in.status() == QDataStream::Ok; i++) {
+		auto part = QSharedPointer<Part>::create();
+		part->ref = readRef(AssetType::Part);
+		part->parent = readRef(AssetType::Folder);
+		part->name = readString();
+		part->properties = readString();
+		mNextId = std::max(mNextId, part->ref.id + 1);
+
+		int numModes = readCount();
+		for (int mi = 0; mi < numModes && in.status() == QDataStream::Ok; mi++) {
+			const QString modeName = readString();
+			Part::Mode m;
+			qint32 width = 0, height = 0, framesPerSecond = 0;
+			in >> width >> height;
+			m.width = width;
+			m.height = height;
+			m.numFrames = readCount();
+			qint32 numPivots = 0;
+			in >> numPivots >> framesPerSecond;
+			if (numPivots < 0 || numPivots > Part::MaxPivots) {
+				in.setStatus(QDataStream::ReadCorruptData);
+				break;
+			}
+			m.numPivots = numPivots;
+			m.framesPerSecond = framesPerSecond;
+
+			for (int frame = 0; frame < m.numFrames; frame++) {
+				const QString imageName = readString();
+				auto image = takeFrame(imageMap, imageName);
+				if (!image) {
+					reason = "Internal data.bin refers to missing image " + imageName;
+					return false;
+				}
+				checkFrameSize(part->name, image, &m.width, &m.height);
+				m.frames.push_back(image);
+			}
+			for (int frame = 0; frame < m.numFrames; frame++) {
+				m.anchor.push_back(readPoint());
+			}
+			for (int p = 0; p < Part::MaxPivots; p++) {
+				for (int frame = 0; frame < m.numFrames; frame++) {
+					m.pivots[p].push_back(p < m.numPivots ? readPoint() : QPoint(0, 0));
+				}
+			}
+			part->modes.insert(modeName, m);
 		}
+		this->parts.insert(part->ref, part);
 	}
 
-	if (!comps.isEmpty()) {
-		for (auto it = comps.begin(); it != comps.end(); it++) {
-			const auto& compObj = it->toObject();
-			auto composite = QSharedPointer<Composite>::create();
-			composite->ref.id = compObj["id"].toInt();
-			composite->ref.type = AssetType::Composite;
-			mNextId = std::max(mNextId, composite->ref.id + 1);
-			jsonToComposite(compObj, composite.get());
-			this->composites.insert(composite->ref, composite);
+	int numComposites = readCount();
+	for (int i = 0; i < numComposites && in.status() == QDataStream::Ok; i++) {
+		auto comp = QSharedPointer<Composite>::create();
+		comp->ref = readRef(AssetType::Composite);
+		comp->parent = readRef(AssetType::Folder);
+		comp->name = readString();
+		comp->properties = readString();
+		mNextId = std::max(mNextId, comp->ref.id + 1);
+
+		qint32 root = -1;
+		in >> root;
+		comp->root = root;
+		int numChildren = readCount();
+		for (int index = 0; index < numChildren && in.status() == QDataStream::Ok; index++) {
+			const QString name = readString();
+			Composite::Child child;
+			qint32 id = -1, parent = -1, parentPivot = -1, z = 0;
+			in >> id;
+			child.part = readRef(AssetType::Part);
+			in >> parent >> parentPivot >> z;
+			child.id = id;
+			child.parent = parent;
+			child.parentPivot = parentPivot;
+			child.z = z;
+			child.index = index;
+			int numChildrenOfChild = readCount();
+			for (int ci = 0; ci < numChildrenOfChild; ci++) {
+				qint32 c = -1;
+				in >> c;
+				child.children.push_back(c);
+			}
+			comp->children.push_back(name);
+			comp->childrenMap.insert(name, child);
 		}
+		this->composites.insert(comp->ref, comp);
 	}
 
-	this->fileName = fileName;
+	if (in.status() != QDataStream::Ok) {
+		reason = "Internal data.bin is truncated or corrupt";
+		return false;
+	}
 	return true;
 }
 
 bool ProjectModel::save(const QString& fileName) {
-	const QDir tempDir { QDir::tempPath() }; // tempPath() takes some time so do it once
-
-	QMap<QString, QSharedPointer<QImage>> imageMap;
-	QMap<QString, QString> fileMap;
+	return write(fileName, true);
+}
 
-	{
-		QJsonObject data;
-		data.insert("version", ProjectFileVersion);
+bool ProjectModel::saveCopy(const QString& fileName) {
+	return write(fileName, false);
+}
 
-		QJsonArray foldersArray;
-		for (auto folder : folders) {
-			QJsonObject folderObject;
-			folderObject.insert("id", folder->ref.id);
-			folderToJson(folder->name, *folder, &folderObject);
-			foldersArray.append(folderObject);
+// Writes the project to fileName. If adoptFile is set it becomes the project's file
+// and unchanged frames are read from and copied from it from now on.
+bool ProjectModel::write(const QString& fileName, bool adoptFile) {
+	QElapsedTimer timer;
+	timer.start();
+	lastSave = {};
+
+	// Hashing is the expensive part of finding identical frames, so do that up front across all cores
+	QVector<Frame> loadedFrames;
+	for (const auto& part : parts) {
+		for (const auto& mode : part->modes) {
+			for (const auto& frame : mode.frames) {
+				if (frame.isLoaded()) loadedFrames.append(frame);
+			}
 		}
-		data.insert("folders", foldersArray);
+	}
+	ParallelFor(loadedFrames.size(), [&](int i) {
+		loadedFrames.at(i).contentHash();
+	});
 
-		QJsonArray partsArray;
-		for (auto part : parts) {
-			QJsonObject partObject;
-			partObject.insert("id", part->ref.id);
-			partToJson(part->name, *part, &partObject, &imageMap);
-			partsArray.append(partObject);
-		}
-		data.insert("parts", partsArray);
+	ImageTable images(mArchive);
+	QMap<QString, ZipEntry> fileMap;
 
-		QJsonArray compArray;
-		for (auto comp: composites) {
-			QJsonObject compObject;
-			compObject.insert("id", comp->ref.id);
-			compositeToJson(comp->name, *comp, &compObject);
-			compArray.append(compObject);
-		}
-		data.insert("comps", compArray);
+	if (GlobalPreferences().binaryProjectData) {
+		fileMap.insert(BinaryDataEntry, { projectToBinary(&images), {} });
+	}
+	else {
+		fileMap.insert("data.json", { projectToJson(&images), {} });
+	}
+	lastSave.imagesShared = images.shared();
 
-		QString pathTemplate = tempDir.absoluteFilePath("data.XXXXXX.json");
-		QTemporaryFile file(pathTemplate);
-		if (!file.open()){
-			exportLog.append("Couldn't create temporary file " + pathTemplate);
-			return false;
+	{
+		// Unchanged images are copied as is from the current archive, so only collect the images that need to be encoded
+		QVector<QString> encodeNames;
+		QVector<Frame> encodeImages;
+		for (auto it = images.entries().begin(); it != images.entries().end(); ++it) {
+			QString source;
+			for (const auto& frame : it.value()) {
+				source = ImageTable::sourceEntry(frame, mArchive);
+				if (!source.isEmpty()) break;
+			}
+			if (!source.isEmpty()) {
+				fileMap.insert(it.key(), { {}, source });
+			}
+			else {
+				encodeNames.append(it.key());
+				encodeImages.append(it.value().first());
+			}
 		}
-		file.setAutoRemove(false);
-		mJunkFiles.append(file.fileName());
 
-		QTextStream out(&file);
-		QJsonDocument doc(data);
-		out << doc.toJson();
-		fileMap.insert("data.json", file.fileName());
+		// Encode in parallel, the results are added to the zip in name order so the archive doesn't depend on scheduling
+		QVector<QByteArray> encoded(encodeImages.size());
+		QVector<bool> encodedOk(encodeImages.size(), false);
+		QByteArray* encodedData = encoded.data();
+		bool* encodedOkData = encodedOk.data();
+		ParallelFor(encodeImages.size(), [&](int i) {
+			QBuffer buffer(&encodedData[i]);
+			buffer.open(QIODevice::WriteOnly);
+			encodedOkData[i] = encodeImages.at(i)->save(&buffer, "PNG");
+		});
+
+		lastSave.imagesCopied = fileMap.size() - 1;
+		for (int i = 0; i < encodeNames.size(); i++) {
+			if (encodedOk.at(i)) {
+				fileMap.insert(encodeNames.at(i), { encoded.at(i), {} });
+				lastSave.imagesEncoded++;
+			}
+			else {
+				exportLog.append("Couldn't save image " + encodeNames.at(i));
+			}
+		}
 	}
 
 	{
-		for (auto it = imageMap.begin(); it != imageMap.end(); ++it) {
-			auto img = it.value();
-			if (img) {
-				
-				bool res = false;
-
-				QString fileName;
-				auto cacheIt = mImageCache.find(img.get());
-				if (cacheIt != mImageCache.end()) {
-					res = true;
-					fileName = cacheIt.value();
-				}
-
-				if (!res){
-					auto imageName = it.key();
-					imageName.replace(' ', '_');
-					imageName.replace('/', '-');
+		// The archive is streamed into a temp file next to fileName, which replaces fileName only once it's complete
+		QSaveFile file(fileName);
+		if (!file.open(QIODevice::WriteOnly)) {
+			exportLog.append("Couldn't create " + fileName + ": " + file.errorString());
+			return false;
+		}
 
-					QString pathTemplate = tempDir.absoluteFilePath(imageName + "-XXXXXX.png");
-					QTemporaryFile file(pathTemplate);
-					if (!file.open()) {
-						exportLog.append("Couldn't create temporary file: " + pathTemplate);
-						return false;
+		const QString sourceArchive = mArchive ? mArchive->fileName() : QString();
+		ZipCompression compression;
+		compression.level = GlobalPreferences().compressionLevel;
+		ZipWriteError error = ZipWriteError::None;
+		bool success = WriteZip(&file, fileMap, sourceArchive, compression, &lastSave.bytesWritten, &error);
+		if (!success) {
+			file.cancelWriting();
+			if (mArchive && error == ZipWriteError::Source) {
+				// The previous archive may have been moved or changed, so try again without it
+				exportLog.append("Couldn't copy unchanged images from " + sourceArchive + ", saving all images again.");
+				for (const auto& frames : images.entries()) {
+					for (const auto& frame : frames) {
+						resetImageCache(frame);
 					}
-					file.setAutoRemove(false);
-					mJunkFiles.append(file.fileName());
-					fileName = file.fileName();
-					res = img->save(&file, "PNG");
 				}
+				clearImageCache();
+				return write(fileName, adoptFile);
+			}
+			exportLog.append("Couldn't write " + fileName + (file.error() != QFileDevice::NoError ? ": " + file.errorString() : QString()));
+			return false;
+		}
 
-				if (res) {
-					fileMap.insert(it.key(), fileName);
-				}
-				else {
-					exportLog.append("Couldn't save image " + it.key());
+		if (!adoptFile) {
+			if (!file.commit()) {
+				exportLog.append("Couldn't write " + fileName + ": " + file.errorString());
+				return false;
+			}
+		}
+		else {
+			QMap<QString, QVector<Frame>> written;
+			for (auto it = images.entries().begin(); it != images.entries().end(); ++it) {
+				if (fileMap.contains(it.key())) {
+					written.insert(it.key(), it.value());
 				}
 			}
+			if (!replaceArchive(file, written)) {
+				return false;
+			}
 		}
 	}
 
-	{
-		QDir tempPath = QDir(QDir::tempPath());
-		QString tempFileName = tempPath.absoluteFilePath("tmp.mqs");
-		bool success = WriteZip(tempFileName, fileMap);
-		if (!success) {
-			exportLog.append("Couldn't write zip!");
-			return false;
+	lastSave.elapsedMs = timer.elapsed();
+	if (adoptFile) this->fileName = fileName;
+	qInfo() << QString("Saved %1 images to %2 (%3 encoded, %4 copied, %5 identical frames shared): %6 bytes in %7ms")
+		.arg(lastSave.imagesEncoded + lastSave.imagesCopied).arg(fileName).arg(lastSave.imagesEncoded).arg(lastSave.imagesCopied)
+		.arg(lastSave.imagesShared).arg(lastSave.bytesWritten).arg(lastSave.elapsedMs);
+	return true;
+}
+
+// Commits the freshly written archive over its destination and makes it the archive frames are read from.
+// Every frame in written has an entry in the new archive. Any other frame that hasn't been decoded
+// yet gets its encoded image copied out of the old archive first, as that file may be replaced.
+bool ProjectModel::replaceArchive(QSaveFile& file, const QMap<QString, QVector<Frame>>& written) {
+	QSet<Frame::Data*> writtenFrames;
+	for (const auto& frames : written) {
+		for (const auto& frame : frames) {
+			writtenFrames.insert(frame.d.data());
 		}
-		if (QFile::exists(fileName)){
-			QFile::remove(fileName);
+	}
+
+	QString oldFileName;
+	if (mArchive) {
+		oldFileName = mArchive->fileName();
+		for (const auto& weakData : mArchiveFrames) {
+			auto data = weakData.toStrongRef();
+			if (data && !writtenFrames.contains(data.data())) {
+				QMutexLocker lock(&data->mutex);
+				if (!data->image && data->png.isNull() && data->archive == mArchive) {
+					data->png = mArchive->read(data->entry);
+				}
+			}
 		}
-		QFile::copy(tempFileName, fileName);	
+
+		// Release the file, an open file can't be renamed over on Windows
+		mArchive->close();
 	}
 
-	this->fileName = fileName;
+	// NB: The rename is atomic, so fileName is either the old or the new archive, never a partial one
+	if (!file.commit()) {
+		exportLog.append("Couldn't write " + file.fileName() + ": " + file.errorString());
+		if (mArchive) {
+			mArchive->open(oldFileName);
+		}
+		return false;
+	}
+
+	auto archive = QSharedPointer<ZipReader>::create();
+	if (!archive->open(file.fileName())) {
+		exportLog.append("Couldn't reopen " + file.fileName());
+		return false;
+	}
+	mArchiveFrames.clear();
+	for (auto it = written.begin(); it != written.end(); ++it) {
+		for (const auto& frame : it.value()) {
+			const auto& data = frame.d;
+			QMutexLocker lock(&data->mutex);
+			data->archive = archive;
+			data->entry = it.key();
+			data->png.clear();
+			mArchiveFrames.append(data);
+		}
+	}
+	mArchive = archive;
 	return true;
 }
 
@@ -408,7 +1248,7 @@ bool ProjectModel::exportSimple(const QString& directoryName) {
 	}
 	exportDir.mkdir("images");
 	
-	QMap<QString, QSharedPointer<QImage>> imageMap;
+	ImageTable images(mArchive);
 	QMap<QString, QString> fileMap;
 
 	{
@@ -428,7 +1268,7 @@ bool ProjectModel::exportSimple(const QString& directoryName) {
 		for (auto part : parts) {
 			QJsonObject partObject;
 			partObject.insert("id", part->ref.id);
-			partToJson(part->name, *part, &partObject, &imageMap);
+			partToJson(part->name, *part, &partObject, &images);
 			partsArray.append(partObject);
 		}
 		data.insert("parts", partsArray);
@@ -449,8 +1289,8 @@ bool ProjectModel::exportSimple(const QString& directoryName) {
 	}
 
 	{
-		for (auto it = imageMap.begin(); it != imageMap.end(); ++it) {
-			auto img = it.value();
+		for (auto it = images.entries().begin(); it != images.entries().end(); ++it) {
+			auto img = it.value().first();
 			if (img) {
 				bool res = false;
 				auto imageName = it.key();
@@ -462,7 +1302,9 @@ bool ProjectModel::exportSimple(const QString& directoryName) {
 					exportLog.append("Couldn't create file: " + imageFilename);
 					return false;
 				}
-				if (!img->save(&file, "PNG")) {
+				// A frame that isn't decoded is written as it's stored
+				const QByteArray png = img.encoded();
+				if (png.isEmpty() || file.write(png) != png.size()) {
 					exportLog.append("Couldn't save image " + it.key());
 				}
 			}
@@ -471,12 +1313,260 @@ bool ProjectModel::exportSimple(const QString& directoryName) {
 	return true;
 }
 
-void ProjectModel::jsonToFolder(const QJsonObject& obj, Folder* folder){
-    folder->name = obj["name"].toString();
-    if (obj.contains("parent")){
-		folder->parent.id = obj["parent"].toInt();
-        folder->parent.type = AssetType::Folder;
-    }
+bool ProjectModel::exportAtlas(const QString& directoryName, const AtlasOptions& options) {
+	exportLog.clear();
+
+	const QDir exportDir { directoryName };
+	if (!exportDir.exists()) {
+		exportLog.append("Export requires a directory!");
+		return false;
+	}
+
+	struct AtlasFrame {
+		const Part* part;
+		QString mode;
+		int frame;
+		Frame image;
+		QSize size;
+		int page;
+		QPoint position;
+	};
+	QVector<AtlasFrame> frames;
+	QMap<QString, QVector<int>> groups; // page name prefix -> frames
+	for (const auto& part : parts) {
+		QString groupName = "atlas";
+		if (options.pagesPerFolder && !part->parent.isNull()) {
+			groupName.append("_" + folderPath(part->parent).join("_"));
+			groupName.replace(QRegExp("[^A-Za-z0-9_-]"), "_");
+		}
+		for (auto mit = part->modes.begin(); mit != part->modes.end(); ++mit) {
+			for (int frame = 0; frame < mit.value().numFrames; frame++) {
+				groups[groupName].append(frames.size());
+				frames.append({ part.data(), mit.key(), frame, mit.value().frames.at(frame), {}, -1, {} });
+			}
+		}
+	}
+
+	// Frames might not be decoded yet, so find the sizes and hashes in parallel
+	AtlasFrame* framesData = frames.data();
+	ParallelFor(frames.size(), [&](int i) {
+		const Frame& image = framesData[i].image;
+		if (image) {
+			framesData[i].size = image->size();
+			image.contentHash();
+		}
+	});
+
+	// Identical frames in a group are packed once and share a rect
+	QVector<int> sharedWith(frames.size(), -1);
+	int numShared = 0;
+	for (auto it = groups.begin(); it != groups.end(); ++it) {
+		ImageTable table;
+		QVector<int> unique;
+		for (int i : it.value()) {
+			const int first = table.add(QString::number(i), frames.at(i).image).toInt();
+			if (first == i) {
+				unique.append(i);
+			}
+			else {
+				sharedWith[i] = first;
+				numShared++;
+			}
+		}
+		it.value() = unique;
+	}
+
+	// Each group is packed independently, largest frames first
+	struct AtlasGroup {
+		QString name;
+		QVector<int> frames;
+		QVector<QSize> pageSizes;
+	};
+	QVector<AtlasGroup> atlasGroups;
+	for (auto it = groups.begin(); it != groups.end(); ++it) {
+		atlasGroups.append({ it.key(), it.value(), {} });
+	}
+	AtlasGroup* atlasGroupsData = atlasGroups.data();
+	ParallelFor(atlasGroups.size(), [&](int g) {
+		AtlasGroup& group = atlasGroupsData[g];
+		std::stable_sort(group.frames.begin(), group.frames.end(), [&](int a, int b) {
+			const QSize& sa = framesData[a].size;
+			const QSize& sb = framesData[b].size;
+			return sa.height() > sb.height() || (sa.height() == sb.height() && sa.width() > sb.width());
+		});
+
+		QList<SkylinePacker> packers;
+		for (int i : group.frames) {
+			AtlasFrame& frame = framesData[i];
+			const QSize paddedSize = frame.size + QSize(options.padding, options.padding);
+			if (frame.size.isEmpty() || paddedSize.width() > options.maxPageSize || paddedSize.height() > options.maxPageSize) {
+				continue;
+			}
+			for (int page = 0; page < packers.size() && frame.page < 0; page++) {
+				if (packers[page].insert(paddedSize, &frame.position)) frame.page = page;
+			}
+			if (frame.page < 0) {
+				packers.append(SkylinePacker(options.maxPageSize, options.maxPageSize));
+				packers.last().insert(paddedSize, &frame.position);
+				frame.page = packers.size() - 1;
+			}
+		}
+		for (const auto& packer : packers) {
+			group.pageSizes.append(QSize(NextPowerOfTwo(packer.usedSize().width()), NextPowerOfTwo(packer.usedSize().height())));
+		}
+	});
+
+	// Number the pages of all groups and make frame pages global
+	struct AtlasPage {
+		QString fileName;
+		QString filePath;
+		QSize size;
+		QVector<int> frames;
+	};
+	QVector<AtlasPage> pages;
+	for (const auto& group : atlasGroups) {
+		const int firstPage = pages.size();
+		for (int page = 0; page < group.pageSizes.size(); page++) {
+			const QString fileName = QString("%1_%2.png").arg(group.name).arg(page);
+			pages.append({ fileName, exportDir.absoluteFilePath(fileName), group.pageSizes.at(page), {} });
+		}
+		for (int i : group.frames) {
+			AtlasFrame& frame = frames[i];
+			if (frame.page < 0) {
+				const QString problem = frame.size.isEmpty() ? "Couldn't load" : "Couldn't fit a page with";
+				exportLog.append(QString("%1 %2 %3 frame %4").arg(problem, frame.part->name, frame.mode).arg(frame.frame));
+				continue;
+			}
+			frame.page += firstPage;
+			pages[frame.page].frames.append(i);
+		}
+	}
+	for (int i = 0; i < frames.size(); i++) {
+		if (sharedWith.at(i) >= 0) {
+			frames[i].page = frames.at(sharedWith.at(i)).page;
+			frames[i].position = frames.at(sharedWith.at(i)).position;
+		}
+	}
+
+	// Pages are drawn and encoded in parallel
+	QVector<bool> pageOk(pages.size(), false);
+	bool* pageOkData = pageOk.data();
+	ParallelFor(pages.size(), [&](int p) {
+		const AtlasPage& page = pages.at(p);
+		QImage image(page.size, QImage::Format_ARGB32);
+		image.fill(Qt::transparent);
+		{
+			QPainter painter(&image);
+			painter.setCompositionMode(QPainter::CompositionMode_Source);
+			for (int i : page.frames) {
+				painter.drawImage(frames.at(i).position, *frames.at(i).image);
+			}
+		}
+		pageOkData[p] = image.save(page.filePath, "PNG");
+	});
+
+	for (int p = 0; p < pages.size(); p++) {
+		if (!pageOk.at(p)) {
+			exportLog.append("Couldn't save page " + pages.at(p).filePath);
+		}
+	}
+
+	// The atlas description has the same layout as data.json, with the page and rect of every frame
+	QJsonObject data;
+	data.insert("version", 1);
+
+	QJsonArray pagesArray;
+	for (const auto& page : pages) {
+		QJsonObject pageObject;
+		pageObject.insert("file", page.fileName);
+		pageObject.insert("width", page.size.width());
+		pageObject.insert("height", page.size.height());
+		pagesArray.append(pageObject);
+	}
+	data.insert("pages", pagesArray);
+
+	QMap<const Part*, QMap<QString, QJsonArray>> frameArrays;
+	for (const auto& frame : frames) {
+		const Part::Mode& m = *frame.part->modes.constFind(frame.mode);
+
+		QJsonObject frameObject;
+		frameObject.insert("page", frame.page); // -1 if the frame isn't in the atlas
+		if (frame.page >= 0) {
+			const QSize& pageSize = pages.at(frame.page).size;
+			const QRect rect { frame.position, frame.size };
+			frameObject.insert("x", rect.x());
+			frameObject.insert("y", rect.y());
+			frameObject.insert("w", rect.width());
+			frameObject.insert("h", rect.height());
+			frameObject.insert("u0", (double) rect.left() / pageSize.width());
+			frameObject.insert("v0", (double) rect.top() / pageSize.height());
+			frameObject.insert("u1", (double) (rect.left() + rect.width()) / pageSize.width());
+			frameObject.insert("v1", (double) (rect.top() + rect.height()) / pageSize.height());
+		}
+		frameObject.insert("ax", m.anchor.at(frame.frame).x());
+		frameObject.insert("ay", m.anchor.at(frame.frame).y());
+		for (int p = 0; p < m.numPivots; p++) {
+			frameObject.insert(QString("p%1x").arg(p), m.pivots[p].at(frame.frame).x());
+			frameObject.insert(QString("p%1y").arg(p), m.pivots[p].at(frame.frame).y());
+		}
+		// Frames were added in order, so the array index matches the frame number
+		frameArrays[frame.part][frame.mode].append(frameObject);
+	}
+
+	QJsonArray partsArray;
+	for (const auto& part : parts) {
+		QJsonObject partObject;
+		partObject.insert("id", part->ref.id);
+		partObject.insert("name", part->name);
+		if (!part->parent.isNull()) {
+			partObject.insert("parent", part->parent.id);
+		}
+		QJsonArray modeArray;
+		for (auto mit = part->modes.begin(); mit != part->modes.end(); ++mit) {
+			QJsonObject modeObject;
+			modeObject.insert("name", mit.key());
+			modeObject.insert("width", mit.value().width);
+			modeObject.insert("height", mit.value().height);
+			modeObject.insert("numFrames", mit.value().numFrames);
+			modeObject.insert("numPivots", mit.value().numPivots);
+			modeObject.insert("framesPerSecond", mit.value().framesPerSecond);
+			modeObject.insert("frames", frameArrays.value(part.data()).value(mit.key()));
+			modeArray.append(modeObject);
+		}
+		partObject.insert("modes", modeArray);
+		partsArray.append(partObject);
+	}
+	data.insert("parts", partsArray);
+
+	QString atlasFilename = exportDir.absoluteFilePath("atlas.json");
+	QFile file(atlasFilename);
+	if (!file.open(QFile::OpenModeFlag::WriteOnly)) {
+		exportLog.append("Couldn't create file " + atlasFilename);
+		return false;
+	}
+	file.write(QJsonDocument(data).toJson());
+
+	qInfo() << QString("Exported %1 frames (%2 identical frames shared) to %3 atlas pages in %4").arg(frames.size()).arg(numShared).arg(pages.size()).arg(directoryName);
+	return true;
+}
+
+void ProjectModel::jsonToFolder(JsonReader& reader, Folder* folder){
+	folder->ref.type = AssetType::Folder;
+	while (reader.readMember()) {
+		if (reader.keyIs("id")) {
+			folder->ref.id = reader.readInt();
+		}
+		else if (reader.keyIs("name")) {
+			folder->name = reader.readString();
+		}
+		else if (reader.keyIs("parent")) {
+			folder->parent.id = reader.readInt();
+			folder->parent.type = AssetType::Folder;
+		}
+		else {
+			reader.skipValue();
+		}
+	}
 }
 
 void ProjectModel::folderToJson(const QString& name, const Folder& folder, QJsonObject* obj){
@@ -487,94 +1577,183 @@ void ProjectModel::folderToJson(const QString& name, const Folder& folder, QJson
     }
 }
 
-void ProjectModel::jsonToPart(const QJsonObject& obj, const QMap<QString,QSharedPointer<QImage>>& imageMap, Part* part){
-	part->name = obj["name"].toString();
+struct JsonFrame {
+	QPoint anchor;
+	QString image;
+	QPoint pivots[Part::MaxPivots];
+};
+
+struct JsonMode {
+	QString name;
+	Part::Mode mode;
+	QList<JsonFrame> frames;
+	bool empty = true;
+};
+
+static void ReadJsonFrame(JsonReader& reader, JsonFrame* frame) {
+	while (reader.readMember()) {
+		if (reader.keyIs("ax")) {
+			frame->anchor.setX(reader.readInt());
+			continue;
+		}
+		else if (reader.keyIs("ay")) {
+			frame->anchor.setY(reader.readInt());
+			continue;
+		}
+		else if (reader.keyIs("image")) {
+			frame->image = reader.readString();
+			continue;
+		}
 
-    if (obj.contains("parent")){
-		part->parent.id = obj["parent"].toInt();
-        part->parent.type = AssetType::Folder;
-    }
+		// p0x, p0y, p1x, ...
+		bool isPivot = false;
+		for (int p = 0; p < Part::MaxPivots && !isPivot; p++) {
+			const char x[] = { 'p', char('0' + p), 'x', '\0' };
+			const char y[] = { 'p', char('0' + p), 'y', '\0' };
+			if (reader.keyIs(x)) {
+				frame->pivots[p].setX(reader.readInt());
+				isPivot = true;
+			}
+			else if (reader.keyIs(y)) {
+				frame->pivots[p].setY(reader.readInt());
+				isPivot = true;
+			}
+		}
+		if (!isPivot) reader.skipValue();
+	}
+}
 
-	if (obj.contains("properties")) {
-		part->properties = importAndFormatProperties(part->name, obj["properties"].toString());
+static void ReadJsonMode(JsonReader& reader, JsonMode* mode) {
+	Part::Mode& m = mode->mode;
+	m.width = m.height = m.numFrames = m.numPivots = m.framesPerSecond = 0;
+	while (reader.readMember()) {
+		mode->empty = false;
+		if (reader.keyIs("name")) mode->name = reader.readString();
+		else if (reader.keyIs("width")) m.width = reader.readInt();
+		else if (reader.keyIs("height")) m.height = reader.readInt();
+		else if (reader.keyIs("numFrames")) m.numFrames = reader.readInt();
+		else if (reader.keyIs("numPivots")) m.numPivots = reader.readInt();
+		else if (reader.keyIs("framesPerSecond")) m.framesPerSecond = reader.readInt();
+		else if (reader.keyIs("frames") && reader.readStartArray()) {
+			while (reader.readElement()) {
+				JsonFrame frame;
+				if (reader.token() == JsonReader::StartObject) {
+					ReadJsonFrame(reader, &frame);
+				}
+				else {
+					reader.skipCurrent();
+				}
+				mode->frames.append(frame);
+			}
+		}
+		else if (reader.token() == JsonReader::Key) {
+			reader.skipValue();
+		}
 	}
+}
 
-	const auto& modeArray = obj["modes"].toArray();
-    for(auto it = modeArray.begin(); it != modeArray.end(); it++){
-		const auto& modeObject = it->toObject();
-        if (!modeObject.isEmpty()){
-			const QString& modeName = modeObject["name"].toString();
+void ProjectModel::jsonToPart(JsonReader& reader, QMap<QString, Frame>& imageMap, Part* part){
+	part->ref.type = AssetType::Part;
 
-            Part::Mode m;
+	bool hasProperties = false;
+	QString properties;
+	QList<JsonMode> modes;
+	while (reader.readMember()) {
+		if (reader.keyIs("id")) {
+			part->ref.id = reader.readInt();
+		}
+		else if (reader.keyIs("name")) {
+			part->name = reader.readString();
+		}
+		else if (reader.keyIs("parent")) {
+			part->parent.id = reader.readInt();
+			part->parent.type = AssetType::Folder;
+		}
+		else if (reader.keyIs("properties")) {
+			hasProperties = true;
+			properties = reader.readString();
+		}
+		else if (reader.keyIs("modes") && reader.readStartArray()) {
+			while (reader.readElement()) {
+				if (reader.token() != JsonReader::StartObject) {
+					reader.skipCurrent();
+					continue;
+				}
+				modes.append(JsonMode());
+				ReadJsonMode(reader, &modes.last());
+			}
+		}
+		else if (reader.token() == JsonReader::Key) {
+			reader.skipValue();
+		}
+	}
 
-            m.width = modeObject.value("width").toInt();
-            m.height = modeObject.value("height").toInt();
-            m.numFrames = modeObject.value("numFrames").toInt();
-            m.numPivots = modeObject.value("numPivots").toInt();
-            m.framesPerSecond = modeObject.value("framesPerSecond").toInt();
-			
-            const QJsonArray& frameArray = modeObject.value("frames").toArray();
-            Q_ASSERT(frameArray.count() == m.numFrames);
-            for(int frame=0;frame<frameArray.count();frame++){
-                const QJsonObject& frameObject = frameArray.at(frame).toObject();
+	// The name may come after the modes, so the frames are only looked up once the whole part is read
+	if (hasProperties) {
+		part->properties = importAndFormatProperties(part->name, properties);
+	}
 
-                int ax = frameObject.value("ax").toInt();
-                int ay = frameObject.value("ay").toInt();
-                m.anchor.push_back(QPoint(ax, ay));
+	for (const auto& mode : modes) {
+		if (mode.empty) continue;
 
-                QString imageName = frameObject.value("image").toString();
-                auto image = imageMap.value(imageName);
-                Q_ASSERT(image);
+		Part::Mode m = mode.mode;
+		Q_ASSERT(mode.frames.size() == m.numFrames);
+		for (const auto& frame : mode.frames) {
+			m.anchor.push_back(frame.anchor);
 
-				int imageHeight = image->height();
-				int imageWidth = image->width();
+			auto image = takeFrame(imageMap, frame.image);
+			Q_ASSERT(image);
 
-				if (imageWidth != m.width || imageHeight != m.height) {
-					importLog.append("Sprite " + part->name + " had invalid width and height! Anchors may be incorrect!");
-					m.width = imageWidth;
-					m.height = imageHeight;
-				}
+			checkFrameSize(part->name, image, &m.width, &m.height);
+			m.frames.push_back(image);
+			for (int p = 0; p < Part::MaxPivots; p++) {
+				m.pivots[p].push_back(p < m.numPivots ? frame.pivots[p] : QPoint(0, 0));
+			}
+		}
 
-				m.frames.push_back(image);
-                for(int p=0;p<m.numPivots;p++){
-                    int px = frameObject.value(QString("p%1x").arg(p)).toInt();
-                    int py = frameObject.value(QString("p%1y").arg(p)).toInt();
-                    m.pivots[p].push_back(QPoint(px,py));
-                }
-                for(int p=m.numPivots;p<Part::MaxPivots;p++){
-                    m.pivots[p].push_back(QPoint(0,0));
-                }
-            }
-
-            part->modes.insert(modeName, m);
-        }
-    }
+		part->modes.insert(mode.name, m);
+	}
 }
 
-static void BuildFolderList(ProjectModel* pm, Folder& folder, QStringList& list) {
-	if (!folder.parent.isNull()) {
-		Q_ASSERT(pm->getFolder(folder.parent) != nullptr);
-		BuildFolderList(pm, *pm->getFolder(folder.parent), list);
+void ProjectModel::checkFrameSize(const QString& partName, const Frame& image, int* width, int* height) {
+	// Checking the size of a frame that isn't loaded would decode it, so its PNG header is used instead
+	QSize size;
+	if (image.isLoaded()) {
+		size = image->size();
+	}
+	else if (image.d) {
+		size = mEntrySizes.value(image.d->entry);
 	}
+	if (size.isValid()) {
+		int imageHeight = size.height();
+		int imageWidth = size.width();
+
+		if (imageWidth != *width || imageHeight != *height) {
+			importLog.append("Sprite " + partName + " had invalid width and height! Anchors may be incorrect!");
+			*width = imageWidth;
+			*height = imageHeight;
+		}
+	}
+}
 
-	list.append(folder.name);
+QString ProjectModel::imageNamePrefixForPart(const QString& name, const Part& part) {
+	QString imageNamePrefix = name;
+	imageNamePrefix.append(" " + QString::number(part.ref.id)); // Append id to ensure uniqueness
+	if (!part.parent.isNull()) {
+		Q_ASSERT(getFolder(part.parent) != nullptr);
+		imageNamePrefix.prepend(folderPath(part.parent).join("_").append("_"));
+	}
+	imageNamePrefix.replace(' ', '_');
+	return imageNamePrefix;
 }
 
-void ProjectModel::partToJson(const QString& name, const Part& part, QJsonObject* obj, QMap<QString, QSharedPointer<QImage>>* imageMap){
+void ProjectModel::partToJson(const QString& name, const Part& part, QJsonObject* obj, ImageTable* images){
     auto properties = part.properties.trimmed();
     if (!properties.isEmpty()){
         obj->insert("properties", "{ " + properties + " }");
     }
 
-    QString imageNamePrefix = name;
-	imageNamePrefix.append(" " + QString::number(part.ref.id)); // Append id to ensure uniqueness
-	if (!part.parent.isNull()) {
-		Q_ASSERT(getFolder(part.parent) != nullptr);
-		QStringList list;
-		BuildFolderList(this, *getFolder(part.parent), list);		
-		imageNamePrefix.prepend(list.join("_").append("_"));
-	}
-	imageNamePrefix.replace(' ', '_');
+    const QString imageNamePrefix = imageNamePrefixForPart(name, part);
 
     obj->insert("name", name);
 
@@ -585,9 +1764,6 @@ void ProjectModel::partToJson(const QString& name, const Part& part, QJsonObject
 	QJsonArray modeArray;
 	for (auto mit = part.modes.begin(); mit != part.modes.end(); ++mit) {
 		const auto& m = mit.value();
-		QString modeNameFixed = mit.key();
-		modeNameFixed.replace(' ', '_');
-
 		QJsonObject modeObject;
 		modeObject.insert("name", mit.key());
 		modeObject.insert("width", m.width);
@@ -601,9 +1777,7 @@ void ProjectModel::partToJson(const QString& name, const Part& part, QJsonObject
 			QJsonObject frameObject;
 			frameObject.insert("ax", m.anchor.at(frame).x());
 			frameObject.insert("ay", m.anchor.at(frame).y());
-			QString frameNum = QString("%1").arg(frame, 3, 10, QChar('0')).toUpper();
-			QString imageName = QString("images/%1_%2_%3.png").arg(imageNamePrefix, modeNameFixed, frameNum);
-			imageMap->insert(imageName, m.frames.at(frame));
+			QString imageName = images->add(frameImageName(imageNamePrefix, mit.key(), frame), m.frames.at(frame));
 			frameObject.insert("image", imageName);
 			for (int p = 0; p < m.numPivots; p++) {
 				frameObject.insert(QString("p%1x").arg(p), m.pivots[p].at(frame).x());
@@ -656,52 +1830,86 @@ void ProjectModel::compositeToJson(const QString& name, const Composite& comp, Q
     obj->insert("parts", compChildren);
 }
 
-void ProjectModel::jsonToComposite(const QJsonObject& obj, Composite* comp){
-    comp->root = obj.value("root").toInt();    
-    comp->name = obj["name"].toString();
+void ProjectModel::jsonToComposite(JsonReader& reader, Composite* comp){
+	comp->ref.type = AssetType::Composite;
+	comp->root = 0;
 
-	if (obj.contains("properties")) {
-		comp->properties = importAndFormatProperties(comp->name, obj["properties"].toString());
-	}
+	bool hasProperties = false;
+	QString properties;
+	while (reader.readMember()) {
+		if (reader.keyIs("id")) {
+			comp->ref.id = reader.readInt();
+		}
+		else if (reader.keyIs("root")) {
+			comp->root = reader.readInt();
+		}
+		else if (reader.keyIs("name")) {
+			comp->name = reader.readString();
+		}
+		else if (reader.keyIs("properties")) {
+			hasProperties = true;
+			properties = reader.readString();
+		}
+		else if (reader.keyIs("parent")) {
+			comp->parent.id = reader.readInt();
+			comp->parent.type = AssetType::Folder;
+		}
+		else if (reader.keyIs("parts") && reader.readStartArray()) {
+			int index = 0;
+			while (reader.readElement()) {
+				QString name;
+				Composite::Child child;
+				child.id = child.parent = child.parentPivot = 0;
+				child.part.type = AssetType::None;
+				int childIndex = -1;
+				bool hasIndex = false;
+				if (reader.token() == JsonReader::StartObject) {
+					while (reader.readMember()) {
+						if (reader.keyIs("name")) name = reader.readString();
+						else if (reader.keyIs("id")) child.id = reader.readInt();
+						else if (reader.keyIs("parent")) child.parent = reader.readInt();
+						else if (reader.keyIs("parentPivot")) child.parentPivot = reader.readInt();
+						else if (reader.keyIs("z")) child.z = reader.readInt();
+						else if (reader.keyIs("index")) {
+							hasIndex = true;
+							childIndex = reader.readInt();
+						}
+						else if (reader.keyIs("part")) {
+							child.part.id = reader.readInt();
+							child.part.type = AssetType::Part;
+						}
+						else if (reader.keyIs("children") && reader.readStartArray()) {
+							while (reader.readElement()) {
+								child.children.push_back(reader.toInt());
+								reader.skipCurrent();
+							}
+						}
+						else if (reader.token() == JsonReader::Key) {
+							reader.skipValue();
+						}
+					}
+				}
+				else {
+					reader.skipCurrent();
+				}
 
-    if (obj.contains("parent")){
-		comp->parent.id = obj["parent"].toInt();
-        comp->parent.type = AssetType::Folder;
-    }
+				child.index = index++;
+				comp->children.push_back(name);
+				comp->childrenMap.insert(name, child);
 
-    const auto& children = obj.value("parts").toArray();
-    int index = 0;
-    for(const auto& value: children){
-        QJsonObject childObject = value.toObject();
-        QString name = childObject.value("name").toString();
-        comp->children.push_back(name);
-
-        Composite::Child child;
-		child.id = childObject.value("id").toInt();
-        child.parent = childObject.value("parent").toInt();
-        child.parentPivot = childObject.value("parentPivot").toInt();
-        child.z = childObject.value("z").toInt();
-		if (childObject.contains("part")) {
-			child.part.id = childObject.value("part").toInt();
-			child.part.type = AssetType::Part;
+				if (hasIndex && childIndex != child.index) {
+					importLog.append("Index of child of " + name + " is incorrect!");
+				}
+			}
 		}
-		else {
-			child.part.type = AssetType::None;
+		else if (reader.token() == JsonReader::Key) {
+			reader.skipValue();
 		}
-        child.index = index++;
-        QJsonArray childrenOfChild = childObject.value("children").toArray();
-        for(const auto& ci: childrenOfChild){
-            child.children.push_back(ci.toInt());
-        }
-        comp->childrenMap.insert(name, child);
+	}
 
-		if (childObject.contains("index")) {
-			int childIndex = childObject.value("index").toInt();
-			if (childIndex != child.index) {
-				importLog.append("Index of child of " + name + " is incorrect!");
-			}
-		}		
-    }
+	if (hasProperties) {
+		comp->properties = importAndFormatProperties(comp->name, properties);
+	}
 }
 
 QString ProjectModel::importAndFormatProperties(const QString& assetName, const QString& properties_) {
@@ -733,11 +1941,32 @@ QString ProjectModel::importAndFormatProperties(const QString& assetName, const
 	return properties;
 }
 
-void ProjectModel::clearImageCache() {
-	for (auto it = mImageCache.begin(); it != mImageCache.end(); ++it) {
-		if (QFile::exists(it.value())) {
-			QFile::remove(it.value());
+QSharedPointer<ProjectModel> ProjectModel::snapshot() const {
+	auto copy = QSharedPointer<ProjectModel>::create();
+	copy->fileName = fileName;
+	copy->mNextId = mNextId;
+	copy->mArchive = mArchive; // only read from, the copy never replaces it
+
+	for (auto it = parts.begin(); it != parts.end(); ++it) {
+		auto part = QSharedPointer<Part>::create(*it.value());
+		for (auto& mode : part->modes) {
+			for (auto& frame : mode.frames) {
+				frame = frame.sharedCopy();
+			}
 		}
+		copy->parts.insert(it.key(), part);
+	}
+	for (auto it = composites.begin(); it != composites.end(); ++it) {
+		copy->composites.insert(it.key(), QSharedPointer<Composite>::create(*it.value()));
+	}
+	for (auto it = folders.begin(); it != folders.end(); ++it) {
+		copy->folders.insert(it.key(), QSharedPointer<Folder>::create(*it.value()));
 	}
-	mImageCache.clear();
+	return copy;
+}
+
+void ProjectModel::clearImageCache() {
+	// Frames still referring to the archive keep it open, so they can still be decoded
+	mArchive.clear();
+	mArchiveFrames.clear();
 }
\ No newline at end of file
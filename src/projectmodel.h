@@ -4,13 +4,26 @@
 #include <QList>
 #include <QImage>
 #include <QMap>
+#include <QHash>
+#include <QPair>
 #include <QString>
+#include <QStringList>
 #include <QPoint>
+#include <QSize>
 #include <QJsonObject>
 #include <QSharedPointer>
+#include <QMutex>
+#include <QAtomicPointer>
+#include <QVector>
 
+#include "slotmap.h"
 
 
+
+class ZipReader;
+class ImageTable;
+class JsonReader;
+class QSaveFile;
 struct Asset;
 struct Part;
 struct Composite;
@@ -30,6 +43,12 @@ struct Preferences {
 	float dropShadowOffsetV = 0.3f;
 	bool showOnionSkinning	= false;
 	float onionSkinningOpacity = 0.2f;
+	bool lazyLoadFrames		= true; // Decode frames when they're first used instead of when the project is opened
+	bool binaryProjectData	= true; // Save data.bin instead of data.json, which is slower to write and parse
+	int compressionLevel	= 6; // Deflate level (0-10) of the project data when saving, frames are stored as they're PNGs
+	int autosaveMinutes		= 5; // 0 disables autosave
+	int undoMemoryMB		= 256; // Frames kept for undo are compressed past half of this, and written to a scratch file past all of it
+	bool quickSave			= false; // Save marks the journal as saved, the project file is written when it's closed
 };
 
 Preferences& GlobalPreferences();
@@ -53,6 +72,76 @@ bool operator<(const AssetRef& a, const AssetRef& b);
 
 uint qHash(const AssetRef &key);
 
+// A handle to the image of a frame, copies share the same image.
+// A frame loaded from a project archive only decodes its image the first
+// time it's accessed, so opening a project doesn't pay for every frame.
+class Frame {
+public:
+	Frame() = default;
+	Frame(QSharedPointer<QImage> image);
+	Frame(QSharedPointer<ZipReader> archive, const QString& entry);
+
+	// Decodes the image if it hasn't been yet, returns nullptr for a null frame
+	QImage* data() const;
+	QImage* get() const { return data(); }
+	QImage* operator->() const { return data(); }
+	QImage& operator*() const { return *data(); }
+
+	bool isNull() const { return d.isNull(); }
+	explicit operator bool() const { return !d.isNull(); }
+	bool isLoaded() const { return d && d->loaded.loadAcquire() != nullptr; }
+
+	// A new handle to the same pixels. The image is implicitly shared, so
+	// whichever frame is painted on first detaches from the other.
+	Frame sharedCopy() const;
+
+	// A hash of the pixels, decoding the image if needed. It's kept until the frame
+	// is modified, see ProjectModel::resetImageCache().
+	quint64 contentHash() const;
+
+	// The bytes the pixels take in memory: the image once it's decoded, otherwise the PNG
+	// it holds. A frame that's only in an archive takes none.
+	qint64 memorySize() const;
+
+	// The pixels encoded as PNG, without decoding them if they haven't been
+	QByteArray encoded() const;
+
+	// A frame that holds png and decodes it when it's first used
+	static Frame fromEncoded(const QByteArray& png);
+
+	// Takes the pixels of copy, made from encoded() and decoded since, if this frame
+	// hasn't been decoded yet, so they aren't decoded again
+	void adoptDecoded(const Frame& copy) const;
+
+private:
+	friend class ProjectModel;
+	friend class ImageTable;
+	friend class Journal;
+	friend class UndoBudget;
+
+	struct Data {
+		QAtomicPointer<QImage> loaded { nullptr }; // == image.data() once decoded
+		QMutex mutex; // guards decoding
+		QSharedPointer<QImage> image;
+		QByteArray png; // encoded image, used instead of the archive if set
+
+		// Where an unchanged copy of the image is stored, cleared when the image is modified
+		QSharedPointer<ZipReader> archive;
+		QString entry;
+
+		// Hash of the pixels, cleared when the image is modified
+		quint64 hash = 0;
+		bool hashed = false;
+	};
+	QSharedPointer<Data> d;
+};
+
+struct AtlasOptions {
+	int maxPageSize = 2048; // pages are power of two sized, up to this
+	int padding = 1; // transparent pixels between frames
+	bool pagesPerFolder = false; // pack the parts in each folder into their own pages
+};
+
 // Global access
 class ProjectModel;
 ProjectModel* PM();
@@ -71,7 +160,9 @@ public:
 	void clear();
 	bool load(const QString& fileName, QString& reason);
 	bool save(const QString& fileName);
+	bool saveCopy(const QString& fileName); // doesn't make fileName the project's file
 	bool exportSimple(const QString& directoryName);
+	bool exportAtlas(const QString& directoryName, const AtlasOptions& options);
 
     AssetRef createAssetRef(AssetType type = AssetType::None);
 
@@ -93,37 +184,107 @@ public:
     Composite* findCompositeByName(const QString& name);
     Folder* findFolderByName(const QString& name);
 
-	// Call this if a qimage changes
-	void resetImageCache(QImage*);
-
-    // Direct access (be careful!)
-    QMap<AssetRef, QSharedPointer<Part>> parts;
-    QMap<AssetRef, QSharedPointer<Composite>> composites;
-    QMap<AssetRef, QSharedPointer<Folder>> folders;
+	// name if no asset of that type has it, otherwise name_N for the first free N from
+	// number (so number 0 tries name itself first)
+	QString uniqueName(AssetType type, const QString& name, int number = 0);
+
+	// Adding, removing, renaming and moving assets with these keeps the name and folder
+	// indexes up to date. Code that changes the maps below directly must call invalidateIndexes().
+	void insertPart(const QSharedPointer<Part>& part);
+	void insertComposite(const QSharedPointer<Composite>& comp);
+	void insertFolder(const QSharedPointer<Folder>& folder);
+	QSharedPointer<Part> takePart(const AssetRef& ref);
+	QSharedPointer<Composite> takeComposite(const AssetRef& ref);
+	QSharedPointer<Folder> takeFolder(const AssetRef& ref);
+	void renameAsset(const AssetRef& ref, const QString& name);
+	void moveAsset(const AssetRef& ref, const AssetRef& parent); // a null parent moves it to the top level
+	void invalidateIndexes();
+
+	// The assets in a folder, or at the top level for a null ref, in the order they were added
+	QVector<AssetRef> children(const AssetRef& folder);
+
+	// The names of folder and the folders it's in, outermost first
+	QStringList folderPath(const AssetRef& folder);
+
+	// Call this if the image of a frame changes
+	void resetImageCache(const Frame& frame);
+
+	// A new handle to the pixels of frame, see Frame::sharedCopy(). Use this for a copy that
+	// stays in the project or its undo stack, so it's still readable once the archive it may
+	// refer to is replaced by a save.
+	Frame sharedCopy(const Frame& frame);
+
+	// A copy of the project that can be saved on another thread while this one is edited.
+	// The frames share their pixels with this project until either copy is drawn on.
+	QSharedPointer<ProjectModel> snapshot() const;
+
+    // Direct access (be careful, see invalidateIndexes())
+    SlotMap<AssetRef, Part> parts;
+    SlotMap<AssetRef, Composite> composites;
+    SlotMap<AssetRef, Folder> folders;
 
     
 
 public:
+	struct SaveStats {
+		int imagesEncoded = 0;
+		int imagesCopied = 0; // from the previous archive, without re-encoding
+		int imagesShared = 0; // frames stored in the same entry as an identical frame
+		qint64 bytesWritten = 0;
+		qint64 elapsedMs = 0;
+	};
+
 	QString fileName {};
 	QList<QString> importLog;
 	QList<QString> exportLog;
+	SaveStats lastSave; // of the last call to save()
 	
 private:
+	friend class Journal;
+
 	int mNextId = 1;
 
-	// Cache the pngs to avoid having to rewrite them unless necessary
-	QMap<QImage*, QString> mImageCache; 
-	QList<QString> mJunkFiles;
+	// The archive the project was loaded from or last saved to. Unchanged frames are
+	// decoded from it on demand and copied from it on save instead of being re-encoded.
+	QSharedPointer<ZipReader> mArchive;
+	QList<QWeakPointer<Frame::Data>> mArchiveFrames; // every frame that may refer to mArchive
+	QHash<QString, QSize> mEntrySizes; // of the PNGs being loaded lazily, read from their headers
+
+	// The refs of the assets with each name and in each folder, rebuilt when they're next
+	// used after invalidateIndexes()
+	bool mIndexesValid = false;
+	QMultiHash<QString, AssetRef> mPartNames;
+	QMultiHash<QString, AssetRef> mCompositeNames;
+	QMultiHash<QString, AssetRef> mFolderNames;
+	QHash<AssetRef, QVector<AssetRef>> mChildren; // by parent, a null ref for the top level
+	QHash<QPair<int, QString>, int> mNextNameNumber; // where uniqueName() continues for a type and name
+	QHash<AssetRef, QStringList> mFolderPaths; // cleared when any folder changes
+
+	QMultiHash<QString, AssetRef>& nameIndex(AssetType type);
+	void ensureIndexes();
+	Asset* findAssetByName(AssetType type, const QString& name);
+	template <class T> void insertAsset(SlotMap<AssetRef, T>& map, const QSharedPointer<T>& asset);
+	template <class T> QSharedPointer<T> takeAsset(SlotMap<AssetRef, T>& map, const AssetRef& ref);
+	void removeChild(const AssetRef& parent, const AssetRef& ref);
 
 protected:
-    void jsonToFolder(const QJsonObject& obj, Folder* folder);
+    void jsonToFolder(JsonReader& reader, Folder* folder);
     void folderToJson(const QString& name, const Folder& folder, QJsonObject* obj);
-    void jsonToPart(const QJsonObject& obj, const QMap<QString, QSharedPointer<QImage>>& imageMap, Part* part);
-    void partToJson(const QString& name, const Part& part, QJsonObject* obj, QMap<QString,QSharedPointer<QImage>>* imageMap);
+	bool jsonToProject(const QByteArray& data, QMap<QString, Frame>& imageMap, QString& reason);
+	QByteArray projectToJson(ImageTable* images);
+	bool binaryToProject(const QByteArray& data, QMap<QString, Frame>& imageMap, QString& reason);
+	QByteArray projectToBinary(ImageTable* images);
+	Frame takeFrame(QMap<QString, Frame>& imageMap, const QString& imageName);
+	QString imageNamePrefixForPart(const QString& name, const Part& part);
+	void checkFrameSize(const QString& partName, const Frame& image, int* width, int* height);
+    void jsonToPart(JsonReader& reader, QMap<QString, Frame>& imageMap, Part* part);
+    void partToJson(const QString& name, const Part& part, QJsonObject* obj, ImageTable* images);
     void compositeToJson(const QString& name, const Composite& comp, QJsonObject* obj);
-    void jsonToComposite(const QJsonObject& obj, Composite* comp);
+    void jsonToComposite(JsonReader& reader, Composite* comp);
 	QString importAndFormatProperties(const QString& assetName, const QString& properties);
 	void clearImageCache();
+	bool write(const QString& fileName, bool adoptFile);
+	bool replaceArchive(QSaveFile& file, const QMap<QString, QVector<Frame>>& written);
 };
 
 struct Asset {
@@ -132,9 +293,8 @@ struct Asset {
 	AssetRef parent {}; // isNull if none
 };
 
-struct Folder: public Asset {
-    QList<AssetRef> children; // NB: not used properly yet
-};
+// The assets in a folder are found with ProjectModel::children()
+struct Folder: public Asset {};
 
 struct Part: public Asset {
 	static const int MaxPivots = 4;
@@ -147,7 +307,7 @@ struct Part: public Asset {
         int framesPerSecond;
 
 		// Each of these are numFrames long
-		QList<QSharedPointer<QImage>> frames;
+		QList<Frame> frames;
         QList<QPoint> anchor;
         QList<QPoint> pivots[Part::MaxPivots];
 
@@ -0,0 +1,185 @@
+#ifndef MMPIXEL_SLOTMAP_H
+#define MMPIXEL_SLOTMAP_H
+
+#include <QHash>
+#include <QList>
+#include <QSharedPointer>
+#include <QVector>
+
+#include <algorithm>
+
+// Stores the assets of one type, keyed by the id of their ref. The assets are kept
+// contiguously, so iterating over them doesn't chase tree nodes, and a slot indexed
+// by the id finds an asset in O(1). Removing an asset moves the last one into its
+// place, so the order of iteration is the order of insertion until something is removed.
+//
+// The interface is the part of QMap that the project uses, plus get(), which returns
+// the asset without copying the shared pointer.
+template <class Key, class T>
+class SlotMap {
+public:
+	class const_iterator {
+	public:
+		const_iterator() = default;
+		const Key& key() const { return mMap->mKeys.at(mIndex); }
+		const QSharedPointer<T>& value() const { return mMap->mValues.at(mIndex); }
+		const QSharedPointer<T>& operator*() const { return value(); }
+		const QSharedPointer<T>* operator->() const { return &value(); }
+		const_iterator& operator++() { ++mIndex; return *this; }
+		const_iterator operator++(int) { const_iterator it = *this; ++mIndex; return it; }
+		bool operator==(const const_iterator& other) const { return mIndex == other.mIndex; }
+		bool operator!=(const const_iterator& other) const { return mIndex != other.mIndex; }
+
+	private:
+		friend class SlotMap;
+		const_iterator(const SlotMap* map, int index): mMap(map), mIndex(index) {}
+		const SlotMap* mMap = nullptr;
+		int mIndex = 0;
+	};
+	typedef const_iterator iterator;
+
+	int size() const { return mValues.size(); }
+	bool isEmpty() const { return mValues.isEmpty(); }
+	int count() const { return mValues.size(); }
+
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, mValues.size()); }
+	const_iterator constBegin() const { return begin(); }
+	const_iterator constEnd() const { return end(); }
+
+	bool contains(const Key& key) const { return indexOf(key) >= 0; }
+
+	T* get(const Key& key) const {
+		const int index = indexOf(key);
+		return index >= 0 ? mValues.at(index).data() : nullptr;
+	}
+
+	QSharedPointer<T> value(const Key& key) const {
+		const int index = indexOf(key);
+		return index >= 0 ? mValues.at(index) : QSharedPointer<T>();
+	}
+
+	// Inserts a null pointer if there's no asset with key, like QMap
+	QSharedPointer<T>& operator[](const Key& key) {
+		int index = indexOf(key);
+		if (index < 0) index = append(key, QSharedPointer<T>());
+		return mValues[index];
+	}
+
+	const QSharedPointer<T>& first() const { return mValues.first(); }
+
+	void insert(const Key& key, const QSharedPointer<T>& value) {
+		const int index = indexOf(key);
+		if (index >= 0) {
+			mKeys[index] = key;
+			mValues[index] = value;
+		}
+		else {
+			append(key, value);
+		}
+	}
+
+	QSharedPointer<T> take(const Key& key) {
+		const int index = indexOf(key);
+		if (index < 0) return QSharedPointer<T>();
+		QSharedPointer<T> value = mValues.at(index);
+		removeAt(index);
+		return value;
+	}
+
+	int remove(const Key& key) {
+		const int index = indexOf(key);
+		if (index < 0) return 0;
+		removeAt(index);
+		return 1;
+	}
+
+	void clear() {
+		mKeys.clear();
+		mValues.clear();
+		mSlots.clear();
+		mFarSlots.clear();
+	}
+
+	QList<Key> keys() const { return mKeys.toList(); }
+	QList<QSharedPointer<T>> values() const { return mValues.toList(); }
+
+private:
+	struct Slot {
+		int index = -1; // in mKeys and mValues
+	};
+
+	// Ids are handed out in order, so they index mSlots directly. Ids far beyond the
+	// others, which only come from hand-edited files, are kept in mFarSlots instead of
+	// growing mSlots to fit them.
+	static const int MinSlots = 1024;
+
+	const Slot* slot(int id) const {
+		if (id >= 0 && id < mSlots.size()) return &mSlots.at(id);
+		if (mFarSlots.isEmpty()) return nullptr;
+		auto it = mFarSlots.constFind(id);
+		return it != mFarSlots.constEnd() ? &it.value() : nullptr;
+	}
+
+	Slot* slot(int id) {
+		if (id >= 0 && id < mSlots.size()) return &mSlots[id];
+		if (mFarSlots.isEmpty()) return nullptr;
+		auto it = mFarSlots.find(id);
+		return it != mFarSlots.end() ? &it.value() : nullptr;
+	}
+
+	Slot* createSlot(int id) {
+		if (Slot* s = slot(id)) return s;
+		if (id >= 0 && id < std::max(MinSlots, mValues.size() * 4)) {
+			const int oldSize = mSlots.size();
+			mSlots.resize(std::max(id + 1, oldSize * 2));
+			for (auto it = mFarSlots.begin(); it != mFarSlots.end();) {
+				if (it.key() >= oldSize && it.key() < mSlots.size()) {
+					mSlots[it.key()] = it.value();
+					it = mFarSlots.erase(it);
+				}
+				else {
+					++it;
+				}
+			}
+			return &mSlots[id];
+		}
+		return &mFarSlots[id];
+	}
+
+	int indexOf(const Key& key) const {
+		const Slot* s = slot(key.id);
+		if (!s || s->index < 0 || !(mKeys.at(s->index) == key)) return -1;
+		return s->index;
+	}
+
+	int append(const Key& key, const QSharedPointer<T>& value) {
+		// A slot can be in use by an asset of another type with the same id
+		Slot* s = createSlot(key.id);
+		if (s->index >= 0) removeAt(s->index);
+		s->index = mValues.size();
+		mKeys.append(key);
+		mValues.append(value);
+		return s->index;
+	}
+
+	void removeAt(int index) {
+		Slot* s = slot(mKeys.at(index).id);
+		s->index = -1;
+		const int last = mValues.size() - 1;
+		if (index != last) {
+			mKeys[index] = mKeys.at(last);
+			mValues[index] = mValues.at(last);
+			slot(mKeys.at(index).id)->index = index;
+		}
+		mKeys.removeLast();
+		mValues.removeLast();
+	}
+
+	QVector<Key> mKeys;
+	QVector<QSharedPointer<T>> mValues;
+	QVector<Slot> mSlots; // indexed by id
+	QHash<int, Slot> mFarSlots;
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include "thumbnails.h"
+#include "xxhash.h"
+
+#include <QMutexLocker>
+#include <QPixmap>
+#include <QRunnable>
+#include <QThread>
+
+#include <functional>
+
+// Icons are 16x16, so this is a few megabytes at most
+static const int MaxCachedImages = 4096;
+
+namespace {
+	class Job: public QRunnable {
+	public:
+		explicit Job(const std::function<void()>& work):mWork(work) {}
+		void run() override { mWork(); }
+	private:
+		std::function<void()> mWork;
+	};
+}
+
+Thumbnails::Thumbnails(QObject *parent) :
+	QObject(parent)
+{
+	// Leave a core for the UI and the other pools
+	mPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+Thumbnails::~Thumbnails() {
+	{
+		QMutexLocker lock(&mMutex);
+		mQueue.clear();
+	}
+	mPool.waitForDone();
+}
+
+QIcon Thumbnails::icon(const Part& part) {
+	Entry& entry = mEntries[part.ref];
+	if (!entry.current && !entry.requested) {
+		request(part, entry);
+	}
+	return entry.icon;
+}
+
+void Thumbnails::invalidate(AssetRef ref) {
+	auto it = mEntries.find(ref);
+	if (it != mEntries.end()) {
+		it->generation++;
+		it->current = false;
+		it->requested = false;
+		it->sources.clear();
+	}
+}
+
+void Thumbnails::clear() {
+	mEntries.clear();
+	mEpoch++; // ignore what's being made for the last project
+	QMutexLocker lock(&mMutex);
+	mQueue.clear();
+}
+
+QVector<Frame> Thumbnails::sourceFrames(const Part& part) {
+	QStringList modeList { "icon", "side", "wrld" };
+	for (const auto& mode : part.modes.keys()) {
+		if (!modeList.contains(mode)) modeList.append(mode);
+	}
+
+	QVector<Frame> frames;
+	for (const auto& mode : modeList) {
+		auto it = part.modes.constFind(mode);
+		if (it != part.modes.constEnd() && !it->frames.isEmpty() && it->frames.first()) {
+			frames.append(it->frames.first());
+		}
+	}
+	return frames;
+}
+
+QImage Thumbnails::createImage(const QVector<Frame>& frames) {
+	for (const auto& frame : frames) {
+		QImage img = *frame;
+		if (img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_ARGB32_Premultiplied) {
+			img = img.convertToFormat(QImage::Format_ARGB32);
+		}
+
+		// Auto-crop to the opaque pixels
+		int cropLeft = img.width();
+		int cropTop = img.height();
+		int cropRight = 0;
+		int cropBottom = 0;
+		for (int y = 0; y < img.height(); ++y) {
+			const QRgb* line = reinterpret_cast<const QRgb*>(img.constScanLine(y));
+			for (int x = 0; x < img.width(); ++x) {
+				if (qAlpha(line[x]) > 0) {
+					if (cropLeft > x) cropLeft = x;
+					if (cropRight < x) cropRight = x;
+					if (cropTop > y) cropTop = y;
+					if (cropBottom < y) cropBottom = y;
+				}
+			}
+		}
+
+		int left = cropLeft;
+		int top = cropTop;
+		int width = 1 + cropRight - cropLeft;
+		int height = 1 + cropBottom - cropTop;
+
+		if (width < 8) {
+			int expand = 8 - width;
+			left -= expand / 2;
+			width += expand;
+		}
+
+		if (height < 8) {
+			int expand = 8 - height;
+			top -= expand / 2;
+			height += expand;
+		}
+
+		if (width > 2 && height > 2) {
+			const QImage copy = img.copy(left, top, width, height);
+			int opaquePixelCount = 0;
+			for (int y = 0; y < copy.height(); ++y) {
+				const QRgb* line = reinterpret_cast<const QRgb*>(copy.constScanLine(y));
+				for (int x = 0; x < copy.width(); ++x) {
+					opaquePixelCount += (int)(qAlpha(line[x]) > 0);
+				}
+			}
+			if (opaquePixelCount > 0.1 * copy.width() * copy.height()) {
+				return copy.scaled(QSize(16, 16));
+			}
+		}
+	}
+
+	return {};
+}
+
+void Thumbnails::request(const Part& part, Entry& entry) {
+	entry.requested = true;
+
+	Request request;
+	request.ref = part.ref;
+	request.generation = entry.generation;
+	request.epoch = mEpoch;
+	entry.sources = sourceFrames(part);
+	for (const auto& frame : entry.sources) {
+		// The pixels of a frame that isn't decoded are copied rather than read from
+		// the project's archive, which is replaced when the project is saved
+		request.frames.append(frame.isLoaded() ? frame.sharedCopy() : Frame::fromEncoded(frame.encoded()));
+	}
+
+	QMutexLocker lock(&mMutex);
+	for (int i = 0; i < mQueue.size(); i++) {
+		if (mQueue.at(i).ref == part.ref) {
+			// Replace the out of date request and make it the next one
+			mQueue.removeAt(i);
+			mQueue.append(request);
+			return;
+		}
+	}
+	mQueue.append(request);
+	lock.unlock();
+
+	auto* job = new Job([this]() { work(); });
+	job->setAutoDelete(true);
+	mPool.start(job);
+}
+
+void Thumbnails::work() {
+	Request request;
+	{
+		QMutexLocker lock(&mMutex);
+		if (mQueue.isEmpty()) return;
+		request = mQueue.takeLast();
+	}
+
+	QVector<quint64> hashes;
+	for (const auto& frame : request.frames) {
+		hashes.append(frame.contentHash());
+	}
+	const quint64 key = XXH64(hashes.constData(), hashes.size() * sizeof(quint64));
+
+	QImage image;
+	bool cached = false;
+	{
+		QMutexLocker lock(&mMutex);
+		auto it = mImages.constFind(key);
+		if (it != mImages.constEnd()) {
+			image = it.value();
+			cached = true;
+		}
+	}
+	if (!cached) {
+		image = createImage(request.frames);
+		QMutexLocker lock(&mMutex);
+		if (mImages.size() >= MaxCachedImages) mImages.clear();
+		mImages.insert(key, image);
+	}
+
+	const AssetRef ref = request.ref;
+	const int generation = request.generation;
+	const int epoch = request.epoch;
+	const QVector<Frame> frames = request.frames;
+	QMetaObject::invokeMethod(this, [this, ref, generation, epoch, image, frames]() {
+		finished(ref, generation, epoch, image, frames);
+	}, Qt::QueuedConnection);
+}
+
+void Thumbnails::finished(AssetRef ref, int generation, int epoch, const QImage& image, const QVector<Frame>& frames) {
+	if (epoch != mEpoch) return;
+	auto it = mEntries.find(ref);
+	if (it == mEntries.end() || it->generation != generation) return;
+
+	// The part's frames that weren't decoded take the pixels decoded for the icon
+	for (int i = 0; i < it->sources.size() && i < frames.size(); i++) {
+		it->sources.at(i).adoptDecoded(frames.at(i));
+	}
+	it->sources.clear();
+
+	// Pixmaps can only be made on the UI thread
+	it->icon = image.isNull() ? QIcon() : QIcon(QPixmap::fromImage(image));
+	it->current = true;
+	it->requested = false;
+	emit iconReady(ref);
+}
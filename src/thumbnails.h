@@ -0,0 +1,76 @@
+#ifndef MMPIXEL_THUMBNAILS_H
+#define MMPIXEL_THUMBNAILS_H
+
+#include "projectmodel.h"
+
+#include <QHash>
+#include <QIcon>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <QVector>
+
+// Makes the icons of parts on worker threads. icon() returns what's there and asks
+// for the icon if it's missing or out of date; iconReady() says when it has arrived.
+// The most recent requests are made first, which are the rows a view is drawing.
+// Icons are cached by the hash of the frames they're made from, so a part whose
+// pixels are back to an earlier state (e.g. after an undo), or a copy of another
+// part, gets its icon without making it again.
+class Thumbnails : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit Thumbnails(QObject *parent = nullptr);
+	~Thumbnails();
+
+	// The icon of part, null if it doesn't have one or it hasn't been made yet.
+	// Until a new icon arrives the last one is returned.
+	QIcon icon(const Part& part);
+
+	void invalidate(AssetRef ref); // the pixels of the part changed
+	void clear(); // the project was replaced
+
+	// Makes the image of an icon, the cropped first frame of the part's icon, side,
+	// wrld or first mode. Null if they're all (nearly) empty.
+	static QVector<Frame> sourceFrames(const Part& part);
+	static QImage createImage(const QVector<Frame>& frames);
+
+signals:
+	void iconReady(AssetRef ref);
+
+private:
+	struct Entry {
+		QIcon icon;
+		int generation = 0; // of the request it was made for
+		bool current = false;
+		bool requested = false;
+		QVector<Frame> sources; // of the request, given the pixels it decodes
+	};
+
+	struct Request {
+		AssetRef ref;
+		int generation = 0;
+		int epoch = 0;
+		QVector<Frame> frames; // private copies of the frames, the part may be drawn on or saved meanwhile
+	};
+
+	void request(const Part& part, Entry& entry);
+	void work();
+	void finished(AssetRef ref, int generation, int epoch, const QImage& image, const QVector<Frame>& frames);
+
+	// The UI thread's
+	QHash<AssetRef, Entry> mEntries;
+	int mEpoch = 0;
+
+	// Shared with the workers
+	QMutex mMutex;
+	QList<Request> mQueue; // newest last
+	QHash<quint64, QImage> mImages; // by the hashes of their frames
+
+	QThreadPool mPool;
+};
+
+#endif
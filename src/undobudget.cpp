@@ -0,0 +1,182 @@
+#include "undobudget.h"
+#include "commands.h"
+#include "parallel.h"
+#include "zip.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QVector>
+
+static const int MaxArchives = 4;
+
+UndoBudget::UndoBudget(QUndoStack* stack, QObject *parent) :
+	QObject(parent),
+	mStack(stack),
+	mBudget((qint64) GlobalPreferences().undoMemoryMB << 20)
+{
+	// Once a burst of changes is over, e.g. undoing several commands
+	mTimer.setSingleShot(true);
+	mTimer.setInterval(0);
+	connect(&mTimer, &QTimer::timeout, this, &UndoBudget::update);
+	connect(mStack, &QUndoStack::indexChanged, this, [this]() { mTimer.start(); });
+}
+
+UndoBudget::~UndoBudget() {
+}
+
+void UndoBudget::setBudget(qint64 bytes) {
+	mBudget = qMax((qint64) 0, bytes);
+	update();
+}
+
+void UndoBudget::update() {
+	mTimer.stop();
+	if (!mStack) return;
+
+	// Compress the frames past half of the budget, counting the newer ones as they are
+	const QList<Frame*> frames = heldFrames();
+	QList<Frame*> compress;
+	qint64 total = 0;
+	for (Frame* frame : frames) {
+		total += frame->memorySize();
+		if (total > mBudget / 2 && frame->isLoaded()) compress.append(frame);
+	}
+	if (!compress.isEmpty()) {
+		QVector<QByteArray> encoded(compress.size());
+		QByteArray* encodedData = encoded.data();
+		ParallelFor(compress.size(), [&](int i) {
+			encodedData[i] = compress.at(i)->encoded();
+		});
+		for (int i = 0; i < compress.size(); i++) {
+			if (!encoded.at(i).isEmpty()) *compress.at(i) = Frame::fromEncoded(encoded.at(i));
+		}
+	}
+
+	// Then write out the oldest ones that are still past it
+	QList<Frame*> spilled;
+	total = 0;
+	for (Frame* frame : frames) {
+		const qint64 size = frame->memorySize();
+		if (size > 0 && total + size > mBudget) spilled.append(frame);
+		else total += size;
+	}
+	if (!spilled.isEmpty()) spill(spilled);
+	removeUnusedArchives();
+	if (mArchives.size() > MaxArchives) compact(frames);
+
+	mUsage = 0;
+	for (Frame* frame : frames) {
+		mUsage += frame->memorySize();
+	}
+	emit usageChanged(mUsage, mBudget);
+}
+
+QList<Frame*> UndoBudget::heldFrames() const {
+	QList<Frame*> frames;
+	for (int i = mStack->index() - 1; i >= 0; i--) {
+		// The undone commands' frames are back in the project, if they hold any
+		auto* command = dynamic_cast<Command*>(const_cast<QUndoCommand*>(mStack->command(i)));
+		if (command) command->heldFrames(frames);
+	}
+
+	// Only the frames the commands hold alone count, the others share their pixels with
+	// the project or with each other, so compressing them wouldn't free anything
+	QHash<Frame::Data*, int> holders;
+	for (Frame* frame : frames) holders[frame->d.data()]++;
+	for (const auto& part : PM()->parts) {
+		for (const auto& mode : part->modes) {
+			for (const auto& frame : mode.frames) {
+				if (frame) holders[frame.d.data()]++;
+			}
+		}
+	}
+	QList<Frame*> own;
+	for (Frame* frame : frames) {
+		if (holders.value(frame->d.data()) != 1) continue;
+		// A shared copy, e.g. of a copied part, has its own data but the same pixels
+		QMutexLocker lock(&frame->d->mutex);
+		if (!frame->d->image || frame->d->image->isDetached()) own.append(frame);
+	}
+	return own;
+}
+
+bool UndoBudget::spill(const QList<Frame*>& frames) {
+	if (!mScratch) mScratch.reset(new QTemporaryDir());
+	if (!mScratch->isValid()) {
+		qWarning() << "Couldn't create a scratch directory for undo:" << mScratch->errorString();
+		return false;
+	}
+
+	// The compressed ones are already encoded
+	QVector<QByteArray> encoded(frames.size());
+	QByteArray* encodedData = encoded.data();
+	ParallelFor(frames.size(), [&](int i) {
+		encodedData[i] = frames.at(i)->encoded();
+	});
+
+	QMap<QString, ZipEntry> entries;
+	for (int i = 0; i < frames.size(); i++) {
+		if (!encoded.at(i).isEmpty()) entries.insert(QString("%1.png").arg(i), { encoded.at(i), {} });
+	}
+
+	const QString fileName = mScratch->filePath(QString("undo-%1.zip").arg(mNextArchive++));
+	if (!WriteZip(fileName, entries)) {
+		qWarning() << "Couldn't write" << fileName;
+		return false;
+	}
+	auto archive = QSharedPointer<ZipReader>::create();
+	if (!archive->open(fileName)) {
+		qWarning() << "Couldn't reopen" << fileName;
+		QFile::remove(fileName);
+		return false;
+	}
+
+	for (int i = 0; i < frames.size(); i++) {
+		if (!encoded.at(i).isEmpty()) *frames.at(i) = Frame(archive, QString("%1.png").arg(i));
+	}
+	mArchives.append({ fileName, archive });
+	return true;
+}
+
+// Rewrites the frames in the scratch archives into a new one once they're spread over too many. The old
+// archives are deleted once nothing refers to them, undone frames that are back in the project may still.
+void UndoBudget::compact(const QList<Frame*>& frames) {
+	QSet<ZipReader*> scratch;
+	for (const auto& archive : mArchives) {
+		auto reader = archive.second.toStrongRef();
+		if (reader) scratch.insert(reader.data());
+	}
+
+	QList<Frame*> spilled;
+	QSet<ZipReader*> used;
+	for (Frame* frame : frames) {
+		if (!frame->d) continue;
+		QMutexLocker lock(&frame->d->mutex);
+		if (!frame->d->image && frame->d->png.isNull() && scratch.contains(frame->d->archive.data())) {
+			spilled.append(frame);
+			used.insert(frame->d->archive.data());
+		}
+	}
+	if (used.size() <= MaxArchives) return;
+	spill(spilled);
+	removeUnusedArchives();
+}
+
+void UndoBudget::removeUnusedArchives() {
+	mSpilled = 0;
+	for (auto it = mArchives.begin(); it != mArchives.end(); ) {
+		if (it->second.isNull()) {
+			QFile::remove(it->first);
+			it = mArchives.erase(it);
+		}
+		else {
+			mSpilled += QFileInfo(it->first).size();
+			++it;
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef MMPIXEL_UNDOBUDGET_H
+#define MMPIXEL_UNDOBUDGET_H
+
+#include "projectmodel.h"
+
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+#include <QScopedPointer>
+#include <QString>
+#include <QTimer>
+#include <QUndoStack>
+#include <QWeakPointer>
+
+class QTemporaryDir;
+class ZipReader;
+
+// Keeps the frames held by the done commands of an undo stack (see Command::heldFrames)
+// within a memory budget. The most recent commands keep their frames decoded so they're
+// undone instantly. Past half of the budget the frames of older commands are compressed
+// to PNGs in memory, and past the budget the oldest are written to a scratch archive.
+// Either way they're decoded again when they're next used, e.g. once they're undone.
+// Frames whose pixels are shared with the project aren't counted or touched.
+// Each spill writes a new archive, which stays open while frames refer to it, so once
+// there are more than a few the frames still in them are rewritten into one.
+class UndoBudget : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit UndoBudget(QUndoStack* stack, QObject *parent = nullptr);
+	~UndoBudget();
+
+	qint64 budget() const { return mBudget; }
+	void setBudget(qint64 bytes);
+
+	// As of the last update()
+	qint64 usage() const { return mUsage; } // in memory, decoded or compressed
+	qint64 spilled() const { return mSpilled; } // in the scratch archives
+
+public slots:
+	// Compresses and spills what's over the budget. It's called soon after the stack changes.
+	void update();
+
+signals:
+	void usageChanged(qint64 usage, qint64 budget);
+
+private:
+	QList<Frame*> heldFrames() const; // the ones only the done commands hold, newest first
+	bool spill(const QList<Frame*>& frames);
+	void compact(const QList<Frame*>& frames);
+	void removeUnusedArchives();
+
+	QPointer<QUndoStack> mStack;
+	qint64 mBudget = 0;
+	qint64 mUsage = 0;
+	qint64 mSpilled = 0;
+	QTimer mTimer;
+
+	QScopedPointer<QTemporaryDir> mScratch; // made when it's first needed
+	QList<QPair<QString, QWeakPointer<ZipReader>>> mArchives; // deleted once no frame reads them
+	int mNextArchive = 0;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef MMPIXEL_XXHASH_H
+#define MMPIXEL_XXHASH_H
+
+#include <QtGlobal>
+#include <cstring>
+
+// XXH64 (https://github.com/Cyan4973/xxHash), used to find identical frames.
+// NB: Reads in native byte order, so hashes are only comparable on the same machine.
+namespace xxhash_detail {
+	static const quint64 Prime1 = 11400714785074694791ULL;
+	static const quint64 Prime2 = 14029467366897019727ULL;
+	static const quint64 Prime3 = 1609587929392839161ULL;
+	static const quint64 Prime4 = 9650029242287828579ULL;
+	static const quint64 Prime5 = 2870177450012600261ULL;
+
+	inline quint64 rotl(quint64 x, int r) { return (x << r) | (x >> (64 - r)); }
+	inline quint64 read64(const uchar* p) { quint64 v; memcpy(&v, p, sizeof(v)); return v; }
+	inline quint32 read32(const uchar* p) { quint32 v; memcpy(&v, p, sizeof(v)); return v; }
+
+	inline quint64 round(quint64 acc, quint64 input) {
+		acc += input * Prime2;
+		acc = rotl(acc, 31);
+		return acc * Prime1;
+	}
+
+	inline quint64 mergeRound(quint64 acc, quint64 val) {
+		acc ^= round(0, val);
+		return acc * Prime1 + Prime4;
+	}
+}
+
+inline quint64 XXH64(const void* input, size_t length, quint64 seed = 0) {
+	using namespace xxhash_detail;
+	const uchar* p = static_cast<const uchar*>(input);
+	const uchar* const end = p + length;
+	quint64 h;
+
+	if (length >= 32) {
+		const uchar* const limit = end - 32;
+		quint64 v1 = seed + Prime1 + Prime2;
+		quint64 v2 = seed + Prime2;
+		quint64 v3 = seed;
+		quint64 v4 = seed - Prime1;
+		do {
+			v1 = round(v1, read64(p)); p += 8;
+			v2 = round(v2, read64(p)); p += 8;
+			v3 = round(v3, read64(p)); p += 8;
+			v4 = round(v4, read64(p)); p += 8;
+		} while (p <= limit);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = mergeRound(h, v1);
+		h = mergeRound(h, v2);
+		h = mergeRound(h, v3);
+		h = mergeRound(h, v4);
+	}
+	else {
+		h = seed + Prime5;
+	}
+
+	h += (quint64) length;
+
+	while (p + 8 <= end) {
+		h ^= round(0, read64(p));
+		h = rotl(h, 27) * Prime1 + Prime4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (quint64) read32(p) * Prime1;
+		h = rotl(h, 23) * Prime2 + Prime3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * Prime5;
+		h = rotl(h, 11) * Prime1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= Prime2;
+	h ^= h >> 29;
+	h *= Prime3;
+	h ^= h >> 32;
+	return h;
+}
+
+#endif
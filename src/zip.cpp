@@ -1,8 +1,11 @@
 #include "zip.h"
+#include "parallel.h"
 
 #include <QDebug>
-#include <QDir>
-#include <QUuid>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QVector>
 #include <cstdlib>
 
 #if defined(__GNUC__) && !defined(__APPLE__)
@@ -24,60 +27,168 @@ static void printErrNo() {
 	}
 }
 
-QMap<QString, QByteArray> LoadZip(QString filename) {
-	QMap<QString, QByteArray> fileMap;
-
+struct ZipReader::State {
 	mz_zip_archive zipFile;
-	memset(&zipFile, 0, sizeof(zipFile));
-	mz_bool status = mz_zip_reader_init_file(&zipFile, filename.toStdString().c_str(), 0);
+	QString fileName;
+	QHash<QString, int> index;
+	QStringList entries;
+	QMutex mutex;
+	bool open = false;
+};
+
+ZipReader::ZipReader():mState(new State()) {
+	memset(&mState->zipFile, 0, sizeof(mState->zipFile));
+}
+
+ZipReader::~ZipReader() {
+	close();
+	delete mState;
+}
+
+bool ZipReader::open(const QString& filename) {
+	close();
+
+	QMutexLocker lock(&mState->mutex);
+	mz_bool status = mz_zip_reader_init_file(&mState->zipFile, filename.toStdString().c_str(), 0);
 	if (!status) {
 		qWarning() << "Couldn't open " << filename << ". Reason: mz_zip_reader_init_file() failed!\n";
 		printErrNo();
-		mz_zip_reader_end(&zipFile);
-		return {};
+		mz_zip_reader_end(&mState->zipFile);
+		memset(&mState->zipFile, 0, sizeof(mState->zipFile));
+		return false;
 	}
 
-	for (int i = 0; i < (int)mz_zip_reader_get_num_files(&zipFile); i++) {
+	// Only the central directory is read here, entries are extracted in read()
+	for (int i = 0; i < (int)mz_zip_reader_get_num_files(&mState->zipFile); i++) {
 		mz_zip_archive_file_stat fileStat;
-		if (!mz_zip_reader_file_stat(&zipFile, i, &fileStat)) {
-			qWarning() << "Couldn't read " << filename << ". Reason: mz_zip_reader_file_stat() failed!\n";
-			printErrNo();
-			mz_zip_reader_end(&zipFile);
-			return {};
+		if (mz_zip_reader_file_stat(&mState->zipFile, i, &fileStat) && !mz_zip_reader_is_file_a_directory(&mState->zipFile, i)) {
+			mState->index.insert(fileStat.m_filename, i);
+			mState->entries.append(fileStat.m_filename);
 		}
+	}
+	mState->fileName = filename;
+	mState->open = true;
+	return true;
+}
 
-		/*
-		qDebug() << "Filename: " << fileStat.m_filename << "\n"
-			<< "Comment: " << fileStat.m_comment << "\n"
-			<< "Uncompressed size: " << fileStat.m_uncomp_size << "\n"
-			<< "Compressed size: " << fileStat.m_comp_size << "\n"
-			<< "Is Dir: " << mz_zip_reader_is_file_a_directory(&zipFile, i) << "\n";
-		*/
-		size_t numBytes = (size_t) fileStat.m_uncomp_size;
-		auto it = fileMap.insert(fileStat.m_filename, {});
-		it->fill('\0', numBytes);
-		// TODO: Speed up saving files by extracting directly to a file and caching it? mz_zip_reader_extract_file_to_file()
-		mz_bool readStatus = mz_zip_reader_extract_file_to_mem(&zipFile, fileStat.m_filename, reinterpret_cast<void*>(it->data()), numBytes, 0);
-		
-		if (!readStatus) {
-			qWarning() << "Couldn't read " << filename << ". Reason: mz_zip_reader_extract_file_to_mem() failed!\n";
-			printErrNo();
-			return {};
-		}
+void ZipReader::close() {
+	QMutexLocker lock(&mState->mutex);
+	if (mState->open) {
+		mz_zip_reader_end(&mState->zipFile);
+		memset(&mState->zipFile, 0, sizeof(mState->zipFile));
 	}
+	mState->index.clear();
+	mState->entries.clear();
+	mState->fileName.clear();
+	mState->open = false;
+}
 
-	mz_zip_reader_end(&zipFile);
-	return fileMap;
+bool ZipReader::isOpen() const {
+	QMutexLocker lock(&mState->mutex);
+	return mState->open;
 }
 
-QMap<QString, QString> LoadZipToFiles(QString filename) {
-	const QDir tempDir{ QDir::tempPath() };
+QString ZipReader::fileName() const {
+	QMutexLocker lock(&mState->mutex);
+	return mState->fileName;
+}
 
-	auto newFileName = [tempDir](){		
-		return tempDir.absoluteFilePath(QUuid::createUuid().toString());
-	};
+QStringList ZipReader::entries() const {
+	QMutexLocker lock(&mState->mutex);
+	return mState->entries;
+}
+
+bool ZipReader::contains(const QString& entry) const {
+	QMutexLocker lock(&mState->mutex);
+	return mState->index.contains(entry);
+}
+
+QByteArray ZipReader::read(const QString& entry) {
+	QMutexLocker lock(&mState->mutex);
+	int i = mState->index.value(entry, -1);
+	if (!mState->open || i < 0) {
+		qWarning() << "Couldn't read " << entry << " from " << mState->fileName;
+		return {};
+	}
+
+	mz_zip_archive_file_stat fileStat;
+	if (!mz_zip_reader_file_stat(&mState->zipFile, i, &fileStat)) {
+		qWarning() << "Couldn't read " << mState->fileName << ". Reason: mz_zip_reader_file_stat() failed!\n";
+		printErrNo();
+		return {};
+	}
+
+	size_t numBytes = (size_t) fileStat.m_uncomp_size;
+	QByteArray bytes(static_cast<int>(numBytes), Qt::Uninitialized);
+	if (!mz_zip_reader_extract_to_mem(&mState->zipFile, i, reinterpret_cast<void*>(bytes.data()), numBytes, 0)) {
+		qWarning() << "Couldn't read " << mState->fileName << ". Reason: mz_zip_reader_extract_to_mem() failed!\n";
+		printErrNo();
+		return {};
+	}
+	return bytes;
+}
+
+bool ZipReader::stat(const QString& entry, quint32* crc32, qint64* size) const {
+	QMutexLocker lock(&mState->mutex);
+	int i = mState->index.value(entry, -1);
+	mz_zip_archive_file_stat fileStat;
+	if (!mState->open || i < 0 || !mz_zip_reader_file_stat(&mState->zipFile, i, &fileStat)) {
+		return false;
+	}
+	*crc32 = fileStat.m_crc32;
+	*size = (qint64) fileStat.m_uncomp_size;
+	return true;
+}
+
+// Collects the first bytes of an entry and stops the extraction once it has them
+struct HeadReader {
+	QByteArray bytes;
+	int size;
+};
+
+static size_t readHeadCallback(void* opaque, mz_uint64 /*offset*/, const void* buffer, size_t n) {
+	auto* head = static_cast<HeadReader*>(opaque);
+	const int needed = head->size - head->bytes.size();
+	head->bytes.append(static_cast<const char*>(buffer), (int) qMin(n, (size_t) needed));
+	// Returning less than n stops it
+	return head->bytes.size() < head->size ? n : 0;
+}
+
+QByteArray ZipReader::readHead(const QString& entry, int size) {
+	QMutexLocker lock(&mState->mutex);
+	int i = mState->index.value(entry, -1);
+	if (!mState->open || i < 0 || size <= 0) {
+		return {};
+	}
+
+	mz_zip_archive_file_stat fileStat;
+	if (!mz_zip_reader_file_stat(&mState->zipFile, i, &fileStat)) {
+		return {};
+	}
+	mz_zip_archive* zip = &mState->zipFile;
+	if (fileStat.m_method == 0) {
+		// Stored, which PNGs are, so read it in place after the local header
+		mz_uint8 localHeader[MzZipLocalDirHeaderSize];
+		if (zip->m_pRead(zip->m_pIO_opaque, fileStat.m_local_header_ofs, localHeader, MzZipLocalDirHeaderSize) != MzZipLocalDirHeaderSize ||
+			MZ_READ_LE32(localHeader) != MzZipLocalDirHeaderSig) {
+			return {};
+		}
+		const mz_uint64 offset = fileStat.m_local_header_ofs + MzZipLocalDirHeaderSize +
+			MZ_READ_LE16(localHeader + MzZipLdhFilenameLenOfs) + MZ_READ_LE16(localHeader + MzZipLdhExtraLenOfs);
+		QByteArray bytes((int) qMin((mz_uint64) size, fileStat.m_comp_size), Qt::Uninitialized);
+		if (zip->m_pRead(zip->m_pIO_opaque, offset, bytes.data(), (size_t) bytes.size()) != (size_t) bytes.size()) {
+			return {};
+		}
+		return bytes;
+	}
 
-	QMap<QString, QString> fileMap;
+	HeadReader head { {}, size };
+	mz_zip_reader_extract_to_callback(zip, i, readHeadCallback, &head, 0);
+	return head.bytes;
+}
+
+QMap<QString, QByteArray> LoadZip(QString filename) {
+	QMap<QString, QByteArray> fileMap;
 
 	mz_zip_archive zipFile;
 	memset(&zipFile, 0, sizeof(zipFile));
@@ -98,45 +209,215 @@ QMap<QString, QString> LoadZipToFiles(QString filename) {
 			return {};
 		}
 
-		auto fileName = newFileName();
-		mz_bool readStatus = mz_zip_reader_extract_file_to_file(&zipFile, fileStat.m_filename, fileName.toStdString().c_str(), 0);
+		if (mz_zip_reader_is_file_a_directory(&zipFile, i)) continue;
+
+		// Extract by index so we don't search the central directory for every entry
+		size_t numBytes = (size_t) fileStat.m_uncomp_size;
+		QByteArray bytes(static_cast<int>(numBytes), Qt::Uninitialized);
+		mz_bool readStatus = mz_zip_reader_extract_to_mem(&zipFile, i, reinterpret_cast<void*>(bytes.data()), numBytes, 0);
 		if (!readStatus) {
-			qWarning() << "Couldn't read " << filename << ". Reason: mz_zip_reader_extract_file_to_mem() failed!\n";
+			qWarning() << "Couldn't read " << filename << ". Reason: mz_zip_reader_extract_to_mem() failed!\n";
 			printErrNo();
+			mz_zip_reader_end(&zipFile);
 			return {};
 		}
 
-		fileMap.insert(fileStat.m_filename, fileName);
+		fileMap.insert(fileStat.m_filename, bytes);
 	}
 
 	mz_zip_reader_end(&zipFile);
 	return fileMap;
 }
 
-bool WriteZip(QString filename, const QMap<QString, QString>& filenames) {
-	// Open zip and dump into directory
+quint32 ZipCrc32(const QByteArray& data) {
+	return (quint32) mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const mz_uint8*>(data.constData()), (size_t) data.size());
+}
+
+// Copies an entry from reader to writer as is, renaming it if necessary
+static bool copyZipEntry(mz_zip_archive* writer, mz_zip_archive* reader, int index, const QString& name, const QString& sourceName) {
+	if (name == sourceName) {
+		return mz_zip_writer_add_from_zip_reader(writer, reader, index);
+	}
+
+	// The name is stored in the local header, so a renamed entry is rewritten with the compressed data as is
+	mz_zip_archive_file_stat fileStat;
+	if (!mz_zip_reader_file_stat(reader, index, &fileStat)) {
+		return false;
+	}
+	size_t numBytes = 0;
+	void* data = mz_zip_reader_extract_to_heap(reader, index, &numBytes, MzZipFlagCompressedData);
+	if (data == nullptr) {
+		return false;
+	}
+	mz_bool status = false;
+	if (fileStat.m_method == 0) {
+		status = mz_zip_writer_add_mem(writer, name.toStdString().c_str(), data, numBytes, MzNoCompression);
+	}
+	else {
+		status = mz_zip_writer_add_mem_ex(writer, name.toStdString().c_str(), data, numBytes, nullptr, 0, MzZipFlagCompressedData, fileStat.m_uncomp_size, fileStat.m_crc32);
+	}
+	reader->m_pFree(reader->m_pAlloc_opaque, data);
+	return status;
+}
+
+// Lets miniz write straight into a QIODevice. Local headers are written after
+// their data, so this has to seek back now and then.
+struct DeviceWriter {
+	QIODevice* device;
+	bool failed; // so a failed copy from the source archive can be told apart from a failed write
+};
+
+static size_t writeToDevice(void* opaque, mz_uint64 offset, const void* buffer, size_t n) {
+	auto* writer = static_cast<DeviceWriter*>(opaque);
+	QIODevice* device = writer->device;
+	if (device->pos() != (qint64) offset && !device->seek((qint64) offset)) {
+		writer->failed = true;
+		return 0;
+	}
+	qint64 written = device->write(static_cast<const char*>(buffer), (qint64) n);
+	if (written != (qint64) n) writer->failed = true;
+	return written < 0 ? 0 : (size_t) written;
+}
+
+int ZipCompression::levelFor(const QString& name) const {
+	return name.endsWith(".png", Qt::CaseInsensitive) ? 0 : level;
+}
+
+bool WriteZip(QString filename, const QMap<QString, ZipEntry>& entries, const QString& sourceArchive, const ZipCompression& compression, qint64* bytesWritten, ZipWriteError* error) {
+	if (error) *error = ZipWriteError::Output;
+	QSaveFile file(filename);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "Couldn't open " << filename << ". Reason: " << file.errorString();
+		return false;
+	}
+	if (!WriteZip(&file, entries, sourceArchive, compression, bytesWritten, error)) {
+		file.cancelWriting();
+		return false;
+	}
+	if (!file.commit()) {
+		qWarning() << "Couldn't write " << filename << ". Reason: " << file.errorString();
+		if (error) *error = ZipWriteError::Output;
+		return false;
+	}
+	return true;
+}
+
+bool WriteZip(QIODevice* device, const QMap<QString, ZipEntry>& entries, const QString& sourceArchive, const ZipCompression& compression, qint64* bytesWritten, ZipWriteError* error) {
+	ZipWriteError unused;
+	if (!error) error = &unused;
+	*error = ZipWriteError::Output;
+
+	mz_zip_archive sourceZip;
+	memset(&sourceZip, 0, sizeof(sourceZip));
+	bool hasSource = false;
+	for (const auto& entry : entries) {
+		if (!entry.source.isEmpty()) {
+			hasSource = true;
+			break;
+		}
+	}
+	// NB: mz_zip_reader_locate_file() is either case insensitive or a linear search, so index the names ourselves
+	QHash<QString, int> sourceIndex;
+	if (hasSource) {
+		mz_bool status = mz_zip_reader_init_file(&sourceZip, sourceArchive.toStdString().c_str(), 0);
+		if (!status) {
+			qWarning() << "Couldn't open " << sourceArchive << ". Reason: mz_zip_reader_init_file() failed!";
+			printErrNo();
+			mz_zip_reader_end(&sourceZip);
+			*error = ZipWriteError::Source;
+			return false;
+		}
+		for (int i = 0; i < (int)mz_zip_reader_get_num_files(&sourceZip); i++) {
+			mz_zip_archive_file_stat fileStat;
+			if (mz_zip_reader_file_stat(&sourceZip, i, &fileStat)) {
+				sourceIndex.insert(fileStat.m_filename, i);
+			}
+		}
+	}
+
+	// Deflate the new entries in parallel, they're appended in order below
+	struct Deflated {
+		void* data;
+		size_t size;
+		mz_uint32 crc;
+	};
+	QVector<QMap<QString, ZipEntry>::const_iterator> order;
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		order.append(it);
+	}
+	QVector<Deflated> deflated(order.size(), { nullptr, 0, 0 });
+	Deflated* deflatedData = deflated.data();
+	ParallelFor(order.size(), [&](int i) {
+		const ZipEntry& entry = order.at(i).value();
+		const int level = compression.levelFor(order.at(i).key());
+		if (!entry.source.isEmpty() || level <= 0 || entry.data.isEmpty()) return;
+
+		const mz_uint flags = tdefl_create_comp_flags_from_zip_params(level, -MZ_DEFAULT_WINDOW_BITS, MzDefaultStrategy);
+		size_t size = 0;
+		void* data = tdefl_compress_mem_to_heap(entry.data.constData(), (size_t) entry.data.size(), &size, (int) flags);
+		if (data && size < (size_t) entry.data.size()) {
+			deflatedData[i] = { data, size, (mz_uint32) mz_crc32(MZ_CRC32_INIT, (const mz_uint8*) entry.data.constData(), (size_t) entry.data.size()) };
+		}
+		else {
+			// Not worth it, store it instead
+			mz_free(data);
+		}
+	});
+	auto freeDeflated = [&]() {
+		for (const auto& d : deflated) mz_free(d.data);
+	};
+
 	mz_zip_archive zipArchive;
 	memset(&zipArchive, 0, sizeof(zipArchive));
-	mz_bool status = mz_zip_writer_init_file(&zipArchive, filename.toStdString().c_str(), 0);
+	DeviceWriter writer { device, false };
+	zipArchive.m_pWrite = writeToDevice;
+	zipArchive.m_pIO_opaque = &writer;
+	mz_bool status = mz_zip_writer_init(&zipArchive, 0);
 	if (!status) {
-		qWarning() << "Couldn't open " << filename << ". Reason: mz_zip_writer_init_file() failed!";
-		printErrNo();
+		qWarning() << "Couldn't write zip. Reason: mz_zip_writer_init() failed!";
 		mz_zip_writer_end(&zipArchive);
+		if (hasSource) mz_zip_reader_end(&sourceZip);
+		freeDeflated();
 		return false;
 	}
 
-	for (auto it = filenames.begin(); it != filenames.end(); ++it) {
-		QChar c;
-		mz_bool writeStatus = mz_zip_writer_add_file(&zipArchive, it.key().toStdString().c_str(), it.value().toStdString().c_str(), nullptr, 0, MzNoCompression);
+	for (int i = 0; i < order.size(); i++) {
+		const QString& name = order.at(i).key();
+		const ZipEntry& entry = order.at(i).value();
+		const Deflated& d = deflated.at(i);
+		mz_bool writeStatus = false;
+		if (!entry.source.isEmpty()) {
+			int index = sourceIndex.value(entry.source, -1);
+			writeStatus = (index >= 0) && copyZipEntry(&zipArchive, &sourceZip, index, name, entry.source);
+		}
+		else if (d.data) {
+			const mz_uint level = (mz_uint) compression.levelFor(name);
+			writeStatus = mz_zip_writer_add_mem_ex(&zipArchive, name.toStdString().c_str(), d.data, d.size, nullptr, 0, level | MzZipFlagCompressedData, (mz_uint64) entry.data.size(), d.crc);
+		}
+		else {
+			writeStatus = mz_zip_writer_add_mem(&zipArchive, name.toStdString().c_str(), entry.data.constData(), (size_t) entry.data.size(), MzNoCompression);
+		}
 		if (!writeStatus) {
-			qWarning() << "Couldn't write " << it.value() << ". Reason: mz_zip_writer_add_file() failed!";
+			qWarning() << "Couldn't write " << name << ". Reason: " << (entry.source.isEmpty() ? "adding it failed!" : "copying it from the source archive failed!");
 			printErrNo();
+			if (!entry.source.isEmpty() && !writer.failed) *error = ZipWriteError::Source;
 			mz_zip_writer_end(&zipArchive);
+			if (hasSource) mz_zip_reader_end(&sourceZip);
+			freeDeflated();
 			return false;
 		}
 	}
+	freeDeflated();
 
-	mz_zip_writer_finalize_archive(&zipArchive);
+	status = mz_zip_writer_finalize_archive(&zipArchive);
+	if (!status) {
+		qWarning() << "Couldn't write zip. Reason: mz_zip_writer_finalize_archive() failed!";
+	}
+	else if (bytesWritten) {
+		*bytesWritten = (qint64) zipArchive.m_archive_size;
+	}
 	mz_zip_writer_end(&zipArchive);
-	return true;
-}
\ No newline at end of file
+	if (hasSource) mz_zip_reader_end(&sourceZip);
+	if (status) *error = ZipWriteError::None;
+	return status;
+}
@@ -2,12 +2,68 @@
 #define MMPIXEL_ZIP_H
 
 #include <QByteArray>
+#include <QIODevice>
 #include <QMap>
 #include <QString>
+#include <QStringList>
+
+// An entry written by WriteZip. If source is set, the entry with that name
+// is copied from the source archive without recompressing it, otherwise
+// data is written.
+struct ZipEntry {
+	QByteArray data;
+	QString source;
+};
+
+// Keeps a zip open so entries can be read on demand. Reading is thread safe.
+class ZipReader {
+public:
+	ZipReader();
+	~ZipReader();
+
+	bool open(const QString& filename);
+	void close();
+	bool isOpen() const;
+	QString fileName() const;
+
+	QStringList entries() const;
+	bool contains(const QString& entry) const;
+	QByteArray read(const QString& entry);
+	QByteArray readHead(const QString& entry, int size); // the first size bytes, without extracting the rest
+	bool stat(const QString& entry, quint32* crc32, qint64* size) const; // of the uncompressed data, from the directory
+
+private:
+	Q_DISABLE_COPY(ZipReader)
+	struct State;
+	State* mState;
+};
+
+// How WriteZip compresses new entries. PNGs are compressed already, so they're
+// stored, and everything else (e.g. project data) is deflated with level.
+struct ZipCompression {
+	int level = 6; // 0 (store) to 10 (best)
+	int levelFor(const QString& name) const;
+};
 
 QMap<QString, QByteArray> LoadZip(QString filename);
-QMap<QString, QString> LoadZipToFiles(QString filename);
-bool WriteZip(QString filename, const QMap<QString, QString>& filenames);
+
+// The CRC-32 of data, as a zip directory stores it
+quint32 ZipCrc32(const QByteArray& data);
+
+// Where WriteZip failed: reading the source archive (e.g. it was moved or changed since
+// it was opened) or writing the new one (e.g. the disk is full)
+enum class ZipWriteError {
+	None,
+	Source,
+	Output
+};
+
+// Writes the archive to a sibling temp file and renames it over filename once it's complete
+bool WriteZip(QString filename, const QMap<QString, ZipEntry>& entries, const QString& sourceArchive = QString(), const ZipCompression& compression = ZipCompression(), qint64* bytesWritten = nullptr, ZipWriteError* error = nullptr);
+
+// Streams the archive into device, which must be open for writing and empty.
+// New entries are compressed in parallel before they're written.
+bool WriteZip(QIODevice* device, const QMap<QString, ZipEntry>& entries, const QString& sourceArchive = QString(), const ZipCompression& compression = ZipCompression(), qint64* bytesWritten = nullptr, ZipWriteError* error = nullptr);
 
 // void SaveProject(ProjectModel* pm, std::string filename);
 // void LoadProject(ProjectModel* pm, std::string filename);